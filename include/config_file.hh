@@ -185,6 +185,14 @@ public:
     items_[section + '/' + key] = value;
   }
 
+  //! removes a key/value pair from the hash map, if it is present
+  /*! @param section the section name of the key
+   *  @param key the key name to be removed
+   */
+  void erase_value(std::string const &section, std::string const &key) {
+    items_.erase(section + '/' + key);
+  }
+
   //! checks if a key is part of the hash map
   /*! @param section the section name of the key
    *  @param key the key name to be checked
@@ -317,6 +317,23 @@ public:
         fbuf2_ = new Grid_FFT<data_t>(N, length_, true, kspace_id);
     }
 
+    /// @brief memory needed by the buffers of one instance
+    /// @param N number of points in each direction
+    static size_t memory_footprint(const std::array<size_t, 3> &N)
+    {
+        return 2 * N[0] * N[1] * (N[2] + 2) * sizeof(real_t);
+    }
+
+    /// @brief recreate the buffers and their FFTW plans, e.g. for a different number of FFTW threads
+    void replan(void)
+    {
+        for (auto buf : {fbuf1_, fbuf2_})
+        {
+            buf->reset();
+            buf->allocate();
+        }
+    }
+
     /// @brief destructor
     ~NaiveConvolver()
     {
@@ -411,17 +428,12 @@ private:
     template <typename kfunc>
     void copy_in(kfunc kf, Grid_FFT<data_t> &g)
     {
-#pragma omp parallel for
-        for (size_t i = 0; i < g.size(0); ++i)
-        {
-            for (size_t j = 0; j < g.size(1); ++j)
+        omp_loops::parallel_for_2d(g.size(0), g.size(1), [&](size_t i, size_t j) {
+            for (size_t k = 0; k < g.size(2); ++k)
             {
-                for (size_t k = 0; k < g.size(2); ++k)
-                {
-                    g.kelem(i, j, k) = kf(i, j, k);
-                }
+                g.kelem(i, j, k) = kf(i, j, k);
             }
-        }
+        });
     }
 };
 
@@ -484,16 +496,34 @@ public:
         size_t tsize = N[0], tsizep = f1p_->size(0);
 
         MPI_Allgather(&fbuf_->local_1_start_, 1, MPI_LONG_LONG, &offsets_[0], 1,
-                      MPI_LONG_LONG, MPI_COMM_WORLD);
+                      MPI_LONG_LONG, MPI::get_comm());
         MPI_Allgather(&f1p_->local_1_start_, 1, MPI_LONG_LONG, &offsetsp_[0], 1,
-                      MPI_LONG_LONG, MPI_COMM_WORLD);
+                      MPI_LONG_LONG, MPI::get_comm());
         MPI_Allgather(&tsize, 1, MPI_LONG_LONG, &sizes_[0], 1, MPI_LONG_LONG,
-                      MPI_COMM_WORLD);
+                      MPI::get_comm());
         MPI_Allgather(&tsizep, 1, MPI_LONG_LONG, &sizesp_[0], 1, MPI_LONG_LONG,
-                      MPI_COMM_WORLD);
+                      MPI::get_comm());
 #endif
     }
 
+    /// @brief memory needed by the buffers of one instance (two padded grids and one unpadded grid)
+    /// @param N grid size
+    static size_t memory_footprint(const std::array<size_t, 3> &N)
+    {
+        const size_t n0p = 3 * N[0] / 2, n1p = 3 * N[1] / 2, n2p = 3 * N[2] / 2;
+        return (2 * n0p * n1p * (n2p + 2) + N[0] * N[1] * (N[2] + 2)) * sizeof(real_t);
+    }
+
+    /// @brief recreate the buffers and their FFTW plans, e.g. for a different number of FFTW threads
+    void replan(void)
+    {
+        for (auto buf : {f1p_, f2p_, fbuf_})
+        {
+            buf->reset();
+            buf->allocate();
+        }
+    }
+
     /// @brief destructor
     ~OrszagConvolver()
     {
@@ -576,34 +606,24 @@ private:
 
         fp.zero();
 
-        #pragma omp parallel for
-        for (size_t i = 0; i < 2 * fp.size(0) / 3; ++i)
-        {
+        omp_loops::parallel_for_2d(2 * fp.size(0) / 3, 2 * fp.size(1) / 3, [&](size_t i, size_t j) {
             size_t ip = (i > nhalf[0]) ? i + nhalf[0] : i;
-            for (size_t j = 0; j < 2 * fp.size(1) / 3; ++j)
+            size_t jp = (j > nhalf[1]) ? j + nhalf[1] : j;
+            for (size_t k = 0; k < nhalf[2]+1; ++k)
             {
-                size_t jp = (j > nhalf[1]) ? j + nhalf[1] : j;
-                for (size_t k = 0; k < nhalf[2]+1; ++k)
-                {
-                    size_t kp = (k > nhalf[2]) ? k + nhalf[2] : k;
-                    fp.kelem(ip, jp, kp) = kfunc(i, j, k) * rfac;
-                }
+                size_t kp = (k > nhalf[2]) ? k + nhalf[2] : k;
+                fp.kelem(ip, jp, kp) = kfunc(i, j, k) * rfac;
             }
-        }
+        });
 #else
         fbuf_->FourierTransformForward(false);
         
-        #pragma omp parallel for
-        for (size_t i = 0; i < fbuf_->size(0); ++i)
-        {
-            for (size_t j = 0; j < fbuf_->size(1); ++j)
+        omp_loops::parallel_for_2d(fbuf_->size(0), fbuf_->size(1), [&](size_t i, size_t j) {
+            for (size_t k = 0; k < fbuf_->size(2); ++k)
             {
-                for (size_t k = 0; k < fbuf_->size(2); ++k)
-                {
-                    fbuf_->kelem(i, j, k) = kfunc(i, j, k) * rfac;
-                }
+                fbuf_->kelem(i, j, k) = kfunc(i, j, k) * rfac;
             }
-        }
+        });
 
         fbuf_->FourierInterpolateCopyTo( fp );
         
@@ -626,24 +646,19 @@ private:
         fbuf_->FourierTransformForward(false);
         size_t nhalf[3] = {fbuf_->n_[0] / 2, fbuf_->n_[1] / 2, fbuf_->n_[2] / 2};
 
-        #pragma omp parallel for
-        for (size_t i = 0; i < fbuf_->size(0); ++i)
-        {
+        omp_loops::parallel_for_2d(fbuf_->size(0), fbuf_->size(1), [&](size_t i, size_t j) {
             size_t ip = (i > nhalf[0]) ? i + nhalf[0] : i;
-            for (size_t j = 0; j < fbuf_->size(1); ++j)
+            size_t jp = (j > nhalf[1]) ? j + nhalf[1] : j;
+            for (size_t k = 0; k < fbuf_->size(2); ++k)
             {
-                size_t jp = (j > nhalf[1]) ? j + nhalf[1] : j;
-                for (size_t k = 0; k < fbuf_->size(2); ++k)
-                {
-                    size_t kp = (k > nhalf[2]) ? k + nhalf[2] : k;
-                    fbuf_->kelem(i, j, k) = fp.kelem(ip, jp, kp) / rfac;
-                    // zero Nyquist modes since they are not unique after convolution
-                    if( i==nhalf[0]||j==nhalf[1]||k==nhalf[2]){
-                        fbuf_->kelem(i, j, k) = 0.0; 
-                    }
+                size_t kp = (k > nhalf[2]) ? k + nhalf[2] : k;
+                fbuf_->kelem(i, j, k) = fp.kelem(ip, jp, kp) / rfac;
+                // zero Nyquist modes since they are not unique after convolution
+                if( i==nhalf[0]||j==nhalf[1]||k==nhalf[2]){
+                    fbuf_->kelem(i, j, k) = 0.0; 
                 }
             }
-        }
+        });
 
         //... copy data back
         #pragma omp parallel for
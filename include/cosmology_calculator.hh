@@ -212,6 +212,14 @@ public:
     //! destructor
     ~calculator() { }
 
+    /// @brief Change the starting time, used when ICs for several starting redshifts are written from one setup
+    /// @param a new starting scale factor
+    void set_starting_scale_factor( double a )
+    {
+        astart_ = a;
+        Dplus_start_ = D_of_a_( astart_ ) / Dnow_;
+    }
+
     /// @brief Write out a correctly scaled power spectrum at time a
     /// @param a scale factor
     /// @param fname file name
@@ -107,10 +107,27 @@ inline double get_wtime()
 namespace MPI
 {
 
+//! communicator of the tasks generating one realisation, MPI_COMM_WORLD unless the job is split into groups
+inline MPI_Comm &comm_ref(void)
+{
+  static MPI_Comm comm = MPI_COMM_WORLD;
+  return comm;
+}
+
+inline MPI_Comm get_comm(void)
+{
+  return comm_ref();
+}
+
+inline void set_comm(MPI_Comm comm)
+{
+  comm_ref() = comm;
+}
+
 inline int get_rank(void)
 {
   int rank, ret;
-  ret = MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  ret = MPI_Comm_rank(get_comm(), &rank);
   assert(ret == MPI_SUCCESS);
   _unused(ret);
   return rank;
@@ -119,7 +136,7 @@ inline int get_rank(void)
 inline int get_size(void)
 {
   int size, ret;
-  ret = MPI_Comm_size(MPI_COMM_WORLD, &size);
+  ret = MPI_Comm_size(get_comm(), &size);
   assert(ret == MPI_SUCCESS);
   _unused(ret);
   return size;
@@ -187,7 +204,7 @@ inline double get_wtime()
 inline void multitask_sync_barrier(void)
 {
 #if defined(USE_MPI)
-  MPI_Barrier(MPI_COMM_WORLD);
+  MPI_Barrier(MPI::get_comm());
 #endif
 }
 
@@ -198,8 +215,11 @@ namespace CONFIG
 extern int MPI_thread_support;
 extern int MPI_task_rank;
 extern int MPI_task_size;
+extern int MPI_group_index;
+extern int MPI_num_groups;
 extern bool MPI_ok;
 extern bool MPI_threads_ok;
 extern bool FFTW_threads_ok;
+extern int FFT_overlap_batches;
 extern int num_threads;
 } // namespace CONFIG
\ No newline at end of file
@@ -17,11 +17,14 @@
 #pragma once
 
 #include <cmath>
+#include <algorithm>
 #include <array>
 #include <vector>
 
 #include <math/vec3.hh>
 #include <general.hh>
+#include <omp_loops.hh>
+#include <numa_memory.hh>
 #include <bounding_box.hh>
 #include <typeinfo>
 
@@ -55,13 +58,20 @@ public:
     std::array<real_t, 3> length_, kfac_, kny_, dx_;
 
     space_t space_;
+    numa_memory::block_t mem_; ///< memory block holding the field data
     data_t *data_;
     ccomplex_t *cdata_;
 
     bounding_box<size_t> global_range_;
 
+    //! wave numbers along each axis for global index m, without (ktab_) and with (kgradtab_) zeroed Nyquist mode
+    std::array<std::vector<real_t>, 3> ktab_, kgradtab_;
+
     fftw_plan_t plan_, iplan_;
 
+    struct slab_fft;       ///< in-house distributed transform with overlapped transposes (see grid_fft.cc)
+    slab_fft *slab_fft_;   ///< non-null if the in-house distributed transform is used instead of FFTW-MPI
+
     real_t fft_norm_fac_;
 
     bool ballocated_;
@@ -75,7 +85,7 @@ public:
     /// @param allocate flag to indicate whether to allocate memory for the grid
     /// @param initialspace flag to indicate whether the grid is initially in real or k-space
     Grid_FFT(const std::array<size_t, 3> &N, const std::array<real_t, 3> &L, bool allocate = true, space_t initialspace = rspace_id)
-        : n_(N), length_(L), space_(initialspace), data_(nullptr), cdata_(nullptr), plan_(nullptr), iplan_(nullptr), ballocated_( false )
+        : n_(N), length_(L), space_(initialspace), data_(nullptr), cdata_(nullptr), plan_(nullptr), iplan_(nullptr), slab_fft_(nullptr), ballocated_( false )
     {
         if( allocate ){
             this->allocate();
@@ -94,9 +104,10 @@ public:
     /// @brief reset grid object (free memory, etc.)
     void reset()
     {
-        if (data_ != nullptr)  { FFTW_API(free)(data_); data_ = nullptr; }
+        if (data_ != nullptr)  { numa_memory::release(mem_); data_ = nullptr; }
         if (plan_ != nullptr)  { FFTW_API(destroy_plan)(plan_); plan_ = nullptr; }
         if (iplan_ != nullptr) { FFTW_API(destroy_plan)(iplan_); iplan_ = nullptr; }
+        if (slab_fft_ != nullptr) { this->free_slab_fft(); }
         ballocated_ = false;
     }
 
@@ -110,6 +121,22 @@ public:
     /// @brief allocate memory for grid object
     void allocate();
 
+    /// @brief tabulate the wave numbers along each axis, called by allocate() once n_ and kfac_ are known
+    void setup_k_tables()
+    {
+        const size_t nmax = *std::max_element(n_.begin(), n_.end());
+        for (int d = 0; d < 3; ++d)
+        {
+            ktab_[d].resize(nmax);
+            kgradtab_[d].resize(nmax);
+            for (size_t m = 0; m < nmax; ++m)
+            {
+                ktab_[d][m] = (real_t(m) - real_t(m > nhalf_[d]) * n_[d]) * kfac_[d];
+                kgradtab_[d][m] = (m != nhalf_[d]) ? ktab_[d][m] : 0.0;
+            }
+        }
+    }
+
     /// @brief return if grid object is allocated
     /// @return true if grid object is allocated
     bool is_allocated( void ) const noexcept { return ballocated_; }
@@ -283,18 +310,51 @@ public:
     {
         vec3_t<ft> kk;
         if( bdistributed ){
-            auto ip = i + local_1_start_;
-            kk[0] = (real_t(j) - real_t(j > nhalf_[0]) * n_[0]) * kfac_[0];
-            kk[1] = (real_t(ip) - real_t(ip > nhalf_[1]) * n_[1]) * kfac_[1];
+            kk[0] = ktab_[0][j];
+            kk[1] = ktab_[1][i + local_1_start_];
         }else{
-            kk[0] = (real_t(i) - real_t(i > nhalf_[0]) * n_[0]) * kfac_[0];
-            kk[1] = (real_t(j) - real_t(j > nhalf_[1]) * n_[1]) * kfac_[1];
+            kk[0] = ktab_[0][i];
+            kk[1] = ktab_[1][j];
         }
-        kk[2] = (real_t(k) - real_t(k > nhalf_[2]) * n_[2]) * kfac_[2];
+        kk[2] = ktab_[2][k];
 
         return kk;
     }
 
+    /// @brief one row of modes along the last dimension, with the first two wave vector components hoisted
+    struct k_row_t
+    {
+        size_t i, j;      //!< local array indices of the row
+        size_t idx0, nk;  //!< linear index of the first mode, and number of modes in the row
+        real_t kx, ky;    //!< wave vector components common to the row
+        const real_t *kz; //!< wave vector components along the row
+    };
+
+    /// @brief call f(row) for all local rows of modes, rows are distributed over threads
+    template <typename functional>
+    void for_each_k_row(const functional &f) const
+    {
+        omp_loops::parallel_for_2d(sizes_[0], sizes_[1], [&](size_t i, size_t j) {
+            const real_t kx = bdistributed ? ktab_[0][j] : ktab_[0][i];
+            const real_t ky = bdistributed ? ktab_[1][i + local_1_start_] : ktab_[1][j];
+            f(k_row_t{i, j, this->get_idx(i, j, 0), sizes_[2], kx, ky, &ktab_[2][0]});
+        });
+    }
+
+    /// @brief call f(idx, k) for all local modes, with linear index idx and wave vector k;
+    ///        the inner loop runs over contiguous memory and vectorises if f can be inlined
+    template <typename functional>
+    void for_each_k(const functional &f) const
+    {
+        this->for_each_k_row([&](const k_row_t &row) {
+            #pragma omp simd
+            for (size_t k = 0; k < row.nk; ++k)
+            {
+                f(row.idx0 + k, vec3_t<real_t>(row.kx, row.ky, row.kz[k]));
+            }
+        });
+    }
+
     template <typename ft>
     vec3_t<ft> get_k(const real_t i, const real_t j, const real_t k) const noexcept
     {
@@ -379,9 +439,7 @@ public:
             ijk[0] += local_1_start_;
             std::swap(ijk[0],ijk[1]);
         }
-        real_t rgrad = 
-            (ijk[idim]!=nhalf_[idim])? (real_t(ijk[idim]) - real_t(ijk[idim] > nhalf_[idim]) * n_[idim]) * kfac_[idim] : 0.0; 
-        return ccomplex_t(0.0,rgrad);
+        return ccomplex_t(0.0,kgradtab_[idim][ijk[idim]]);
     }
 
     inline real_t laplacian( const std::array<size_t,3>& ijk ) const noexcept
@@ -451,41 +509,31 @@ public:
     template <typename functional>
     void apply_function_k(const functional &f)
     {
-#pragma omp parallel for
-        for (size_t i = 0; i < sizes_[0]; ++i)
-        {
-            for (size_t j = 0; j < sizes_[1]; ++j)
+        omp_loops::parallel_for_2d(sizes_[0], sizes_[1], [&](size_t i, size_t j) {
+            for (size_t k = 0; k < sizes_[2]; ++k)
             {
-                for (size_t k = 0; k < sizes_[2]; ++k)
-                {
-                    auto &elem = this->kelem(i, j, k);
-                    elem = f(elem);
-                }
+                auto &elem = this->kelem(i, j, k);
+                elem = f(elem);
             }
-        }
+        });
     }
 
     template <typename functional>
     void apply_function_r(const functional &f)
     {
-#pragma omp parallel for
-        for (size_t i = 0; i < sizes_[0]; ++i)
-        {
-            for (size_t j = 0; j < sizes_[1]; ++j)
+        omp_loops::parallel_for_2d(sizes_[0], sizes_[1], [&](size_t i, size_t j) {
+            for (size_t k = 0; k < sizes_[2]; ++k)
             {
-                for (size_t k = 0; k < sizes_[2]; ++k)
-                {
-                    auto &elem = this->relem(i, j, k);
-                    elem = f(elem);
-                }
+                auto &elem = this->relem(i, j, k);
+                elem = f(elem);
             }
-        }
+        });
     }
 
     real_t compute_2norm(void) const
     {
         real_t sum1{0.0};
-        #pragma omp parallel for reduction(+ : sum1)
+        #pragma omp parallel for collapse(2) schedule(runtime) reduction(+ : sum1)
         for (size_t i = 0; i < sizes_[0]; ++i)
         {
             for (size_t j = 0; j < sizes_[1]; ++j)
@@ -509,7 +557,7 @@ public:
         double sum1{0.0}, sum2{0.0};
         size_t count{0};
 
-        #pragma omp parallel for reduction(+ : sum1, sum2)
+        #pragma omp parallel for collapse(2) schedule(runtime) reduction(+ : sum1, sum2)
         for (size_t i = 0; i < sizes_[0]; ++i)
         {
             for (size_t j = 0; j < sizes_[1]; ++j)
@@ -531,15 +579,15 @@ public:
 
             MPI_Allreduce(reinterpret_cast<const void *>(&sum1),
                         reinterpret_cast<void *>(&globsum1),
-                        1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+                        1, MPI_DOUBLE, MPI_SUM, MPI::get_comm());
 
             MPI_Allreduce(reinterpret_cast<const void *>(&sum2),
                         reinterpret_cast<void *>(&globsum2),
-                        1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+                        1, MPI_DOUBLE, MPI_SUM, MPI::get_comm());
 
             MPI_Allreduce(reinterpret_cast<const void *>(&count),
                         reinterpret_cast<void *>(&globcount),
-                        1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+                        1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, MPI::get_comm());
 
             sum1 = globsum1;
             sum2 = globsum2;
@@ -557,7 +605,7 @@ public:
         double sum1{0.0};
         size_t count{0};
 
-        #pragma omp parallel for reduction(+ : sum1)
+        #pragma omp parallel for collapse(2) schedule(runtime) reduction(+ : sum1)
         for (size_t i = 0; i < sizes_[0]; ++i)
         {
             for (size_t j = 0; j < sizes_[1]; ++j)
@@ -578,11 +626,11 @@ public:
 
             MPI_Allreduce(reinterpret_cast<const void *>(&sum1),
                         reinterpret_cast<void *>(&globsum1),
-                        1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+                        1, MPI_DOUBLE, MPI_SUM, MPI::get_comm());
 
             MPI_Allreduce(reinterpret_cast<const void *>(&count),
                         reinterpret_cast<void *>(&globcount),
-                        1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+                        1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, MPI::get_comm());
 
             sum1 = globsum1;
             count = globcount;
@@ -598,7 +646,7 @@ public:
     {
         double locmax{-1e30};
 
-        #pragma omp parallel for reduction(max : locmax)
+        #pragma omp parallel for collapse(2) schedule(runtime) reduction(max : locmax)
         for (size_t i = 0; i < sizes_[0]; ++i)
         {
             for (size_t j = 0; j < sizes_[1]; ++j)
@@ -618,7 +666,7 @@ public:
 
             MPI_Allreduce(reinterpret_cast<const void *>(&locmax),
                         reinterpret_cast<void *>(&globmax),
-                        1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+                        1, MPI_DOUBLE, MPI_MAX, MPI::get_comm());
 
             locmax  = globmax;
         }
@@ -631,7 +679,7 @@ public:
     {
         double locmax{-1e30};
 
-        #pragma omp parallel for reduction(max : locmax)
+        #pragma omp parallel for collapse(2) schedule(runtime) reduction(max : locmax)
         for (size_t i = 0; i < sizes_[0]; ++i)
         {
             for (size_t j = 0; j < sizes_[1]; ++j)
@@ -651,7 +699,7 @@ public:
 
             MPI_Allreduce(reinterpret_cast<const void *>(&locmax),
                         reinterpret_cast<void *>(&globmax),
-                        1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+                        1, MPI_DOUBLE, MPI_MAX, MPI::get_comm());
 
             locmax  = globmax;
         }
@@ -664,7 +712,7 @@ public:
     {
         double locmin{+1e30};
 
-        #pragma omp parallel for reduction(min : locmin)
+        #pragma omp parallel for collapse(2) schedule(runtime) reduction(min : locmin)
         for (size_t i = 0; i < sizes_[0]; ++i)
         {
             for (size_t j = 0; j < sizes_[1]; ++j)
@@ -684,7 +732,7 @@ public:
 
             MPI_Allreduce(reinterpret_cast<const void *>(&locmin),
                         reinterpret_cast<void *>(&globmin),
-                        1, MPI_DOUBLE, MPI_MIN, MPI_COMM_WORLD);
+                        1, MPI_DOUBLE, MPI_MIN, MPI::get_comm());
 
             locmin  = globmin;
         }
@@ -700,17 +748,12 @@ public:
     {
         list_assert_all( { ((grids.size(0)==this->size(0))&&(grids.size(1)==this->size(1))&&(grids.size(2)==this->size(2)))... } );
 
-        #pragma omp parallel for
-        for (size_t i = 0; i < sizes_[0]; ++i)
-        {
-            for (size_t j = 0; j < sizes_[1]; ++j)
+        omp_loops::parallel_for_2d(sizes_[0], sizes_[1], [&](size_t i, size_t j) {
+            for (size_t k = 0; k < sizes_[2]; ++k)
             {
-                for (size_t k = 0; k < sizes_[2]; ++k)
-                {
-                    this->relem(i, j, k) = f((grids.relem(i, j, k))...);
-                }
+                this->relem(i, j, k) = f((grids.relem(i, j, k))...);
             }
-        }
+        });
     }
 
     //! In Fourier space, assigns the value of a functional of arbitrarily many grids, i.e. f(k) = f(g1(k),g2(k),...)
@@ -719,17 +762,13 @@ public:
     {
         list_assert_all( { ((grids.size(0)==this->size(0))&&(grids.size(1)==this->size(1))&&(grids.size(2)==this->size(2)))... } );
 
-        #pragma omp parallel for
-        for (size_t i = 0; i < sizes_[0]; ++i)
-        {
-            for (size_t j = 0; j < sizes_[1]; ++j)
+        this->for_each_k_row([&](const k_row_t &row) {
+            #pragma omp simd
+            for (size_t k = 0; k < row.nk; ++k)
             {
-                for (size_t k = 0; k < sizes_[2]; ++k)
-                {
-                    this->kelem(i, j, k) = f((grids.kelem(i, j, k))...);
-                }
+                this->kelem(row.idx0 + k) = f((grids.kelem(row.idx0 + k))...);
             }
-        }
+        });
     }
 
     //! In Fourier space, assigns the value of a functional of arbitrarily many grids where first argument is the 3d array index
@@ -739,17 +778,12 @@ public:
     {
         list_assert_all( { ((grids.size(0)==this->size(0))&&(grids.size(1)==this->size(1))&&(grids.size(2)==this->size(2)))... } );
 
-        #pragma omp parallel for
-        for (size_t i = 0; i < sizes_[0]; ++i)
-        {
-            for (size_t j = 0; j < sizes_[1]; ++j)
+        this->for_each_k_row([&](const k_row_t &row) {
+            for (size_t k = 0; k < row.nk; ++k)
             {
-                for (size_t k = 0; k < sizes_[2]; ++k)
-                {
-                    this->kelem(i, j, k) = f({i, j, k}, (grids.kelem(i, j, k))...);
-                }
+                this->kelem(row.idx0 + k) = f({row.i, row.j, k}, (grids.kelem(row.idx0 + k))...);
             }
-        }
+        });
     }
 
     //! In Fourier space, assigns the value of a functional of arbitrarily many grids where first argument is the k vector
@@ -760,51 +794,30 @@ public:
         // check that all grids are same size
         list_assert_all( { ((grids.size(0)==this->size(0))&&(grids.size(1)==this->size(1))&&(grids.size(2)==this->size(2)))... } );
 
-        #pragma omp parallel for
-        for (size_t i = 0; i < sizes_[0]; ++i)
-        {
-            for (size_t j = 0; j < sizes_[1]; ++j)
-            {
-                for (size_t k = 0; k < sizes_[2]; ++k)
-                {
-                    this->kelem(i, j, k) = f(this->get_k<real_t>(i, j, k), (grids.kelem(i, j, k))...);
-                }
-            }
-        }
+        this->for_each_k([&](size_t idx, const vec3_t<real_t> &kk) {
+            this->kelem(idx) = f(kk, (grids.kelem(idx))...);
+        });
     }
 
     template <typename functional>
     void apply_function_k_dep(const functional &f)
     {
-        #pragma omp parallel for
-        for (size_t i = 0; i < sizes_[0]; ++i)
-        {
-            for (size_t j = 0; j < sizes_[1]; ++j)
-            {
-                for (size_t k = 0; k < sizes_[2]; ++k)
-                {
-                    auto &elem = this->kelem(i, j, k);
-                    elem = f(elem, this->get_k<real_t>(i, j, k));
-                }
-            }
-        }
+        this->for_each_k([&](size_t idx, const vec3_t<real_t> &kk) {
+            auto &elem = this->kelem(idx);
+            elem = f(elem, kk);
+        });
     }
 
     template <typename functional>
     void apply_function_r_dep(const functional &f)
     {
-        #pragma omp parallel for
-        for (size_t i = 0; i < sizes_[0]; ++i)
-        {
-            for (size_t j = 0; j < sizes_[1]; ++j)
+        omp_loops::parallel_for_2d(sizes_[0], sizes_[1], [&](size_t i, size_t j) {
+            for (size_t k = 0; k < sizes_[2]; ++k)
             {
-                for (size_t k = 0; k < sizes_[2]; ++k)
-                {
-                    auto &elem = this->relem(i, j, k);
-                    elem = f(elem, this->get_r<real_t>(i, j, k));
-                }
+                auto &elem = this->relem(i, j, k);
+                elem = f(elem, this->get_r<real_t>(i, j, k));
             }
-        }
+        });
     }
 
     //! perform a backwards Fourier transform
@@ -813,6 +826,18 @@ public:
     //! perform a forwards Fourier transform
     void FourierTransformForward(bool do_transform = true);
 
+    //! set up the in-house distributed transform, if enabled
+    void setup_slab_fft(void);
+
+    //! release the in-house distributed transform
+    void free_slab_fft(void);
+
+    //! forward transform with the in-house distributed transform, overlapping transposes with 2D transforms
+    void slab_fft_forward(void);
+
+    //! backward transform with the in-house distributed transform, overlapping transposes with 1D transforms
+    void slab_fft_backward(void);
+
     //! perform a copy operation between to FFT grids that might not be of the same size
     void FourierInterpolateCopyTo( grid_fft_t &grid_to );
 
@@ -866,23 +891,18 @@ public:
 #if defined(USE_MPI)
                 data_t glob_sum = 0.0;
                 MPI_Allreduce(reinterpret_cast<void *>(&sum), reinterpret_cast<void *>(&glob_sum),
-                            1, MPI::get_datatype<data_t>(), MPI_SUM, MPI_COMM_WORLD);
+                            1, MPI::get_datatype<data_t>(), MPI_SUM, MPI::get_comm());
                 sum = glob_sum;
 #endif
             }
             sum /= sizes_[0] * sizes_[1] * sizes_[2];
 
-#pragma omp parallel for
-            for (size_t i = 0; i < sizes_[0]; ++i)
-            {
-                for (size_t j = 0; j < sizes_[1]; ++j)
+            omp_loops::parallel_for_2d(sizes_[0], sizes_[1], [&](size_t i, size_t j) {
+                for (size_t k = 0; k < sizes_[2]; ++k)
                 {
-                    for (size_t k = 0; k < sizes_[2]; ++k)
-                    {
-                        this->relem(i, j, k) -= sum;
-                    }
+                    this->relem(i, j, k) -= sum;
                 }
-            }
+            });
         }
     }
 
@@ -912,3 +932,6 @@ public:
         }
     }
 };
+
+//! free the MPI datatypes cached by FourierInterpolateCopyTo, needs to be called before MPI_Finalize
+void free_fourier_copy_plans(void);
@@ -16,7 +16,9 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #pragma once
 
+#include <algorithm>
 #include <array>
+#include <cassert>
 #include <vector>
 #include <numeric>
 
@@ -47,22 +49,50 @@ struct grid_with_ghosts
   //... determine communication offsets
   std::vector<ptrdiff_t> offsets_, sizes_;
 
+#if defined(USE_MPI)
+  MPI_Comm neighbour_comm_;                     //!< graph communicator connecting only tasks that exchange ghosts
+  std::vector<int> sources_, destinations_;     //!< tasks we receive ghost planes from / send planes to
+  std::vector<std::vector<size_t>> send_planes_; //!< local planes packed for each destination
+  std::vector<std::vector<size_t>> recv_slots_;  //!< ghost slots unpacked from each source, left slots first
+  std::vector<std::vector<data_t>> sendbuf_, recvbuf_;
+  std::vector<MPI_Request> requests_;           //!< persistent requests, receives first
+#endif
+
   /// @brief get task index for a given index
   /// @param index index
   /// @return task index
   int get_task(ptrdiff_t index) const
   {
     int itask = 0;
-    while (itask < MPI::get_size() - 1 && offsets_[itask + 1] <= index)
+    while (itask < int(sizes_.size()) - 1 && offsets_[itask + 1] <= index)
         ++itask;
     return itask;
   }
 
+  /// @brief global plane index held in ghost slot islot of a task, left slots come first
+  /// @param itask task index
+  /// @param islot ghost slot index in [0,2*num_ghosts)
+  /// @return global plane index
+  ptrdiff_t get_ghost_plane(int itask, int islot) const
+  {
+    const ptrdiff_t n0 = ptrdiff_t(nx_);
+    if( islot < num_ghosts )
+      return (offsets_[itask] + n0 - num_ghosts + islot) % n0;
+    return (offsets_[itask] + sizes_[itask] + islot - num_ghosts) % n0;
+  }
+
+  /// @brief whether ghost slot islot is in use
+  static bool have_slot(int islot)
+  {
+    return (islot < num_ghosts) ? have_left : have_right;
+  }
+
   /// @brief constructor for grid with ghosts
   /// @param g grid to wrap
   explicit grid_with_ghosts(const grid_t &g)
-  : gridref(g), nx_(g.n_[0]), ny_(g.n_[1]), nz_(g.n_[2]), nzp_(g.n_[2]+2)
+  : gridref(g), nx_(g.n_[0]), ny_(g.n_[1]), nz_(g.n_[2]), nzp_(g.npr_)
   {
+#if defined(USE_MPI)
     if (is_distributed_trait)
     {
       int ntasks(MPI::get_size());
@@ -71,124 +101,116 @@ struct grid_with_ghosts
       sizes_.assign(ntasks, 0);
       
       MPI_Allgather(&g.local_0_size_, 1, MPI_LONG_LONG, &sizes_[0], 1,
-                      MPI_LONG_LONG, MPI_COMM_WORLD);
+                      MPI_LONG_LONG, MPI::get_comm());
       MPI_Allgather(&g.local_0_start_, 1, MPI_LONG_LONG, &offsets_[0], 1,
-                      MPI_LONG_LONG, MPI_COMM_WORLD);
+                      MPI_LONG_LONG, MPI::get_comm());
       
-      for( int i=0; i< CONFIG::MPI_task_size; i++ ){
+      for( int i=0; i< ntasks; i++ ){
           if( offsets_[i+1] < offsets_[i] + sizes_[i] ) offsets_[i+1] = offsets_[i] + sizes_[i];
       }
 
-      update_ghosts_allow_multiple( g );
+      if( have_left  ) boundary_left_.assign(num_ghosts * ny_ * nzp_, data_t{0.0});
+      if( have_right ) boundary_right_.assign(num_ghosts * ny_ * nzp_, data_t{0.0});
+
+      this->setup_exchange();
+      this->update_ghosts_allow_multiple( g );
     }
+#endif
   }
 
-  /// @brief update ghost zones via MPI communication
-  /// @param g grid to wrap
-  void update_ghosts_allow_multiple( const grid_t &g )
+  // persistent requests refer to our buffers, so the object must not be copied
+  grid_with_ghosts(const grid_with_ghosts &) = delete;
+  grid_with_ghosts &operator=(const grid_with_ghosts &) = delete;
+
+  ~grid_with_ghosts()
   {
-  #if defined(USE_MPI)
-    //... exchange boundary
-    if( have_left  ) boundary_left_.assign(num_ghosts * ny_ * nzp_, data_t{0.0});
-    if( have_right ) boundary_right_.assign(num_ghosts * ny_ * nzp_, data_t{0.0});
-
-    size_t slicesz = ny_ * nzp_;
-
-    MPI_Status status;
-    std::vector<MPI_Request> req;
-    MPI_Request temp_req;
-
-    if( have_right ){
-      for( int itask=0; itask<CONFIG::MPI_task_size; ++itask ){
-        for( size_t i=0; i<num_ghosts; ++i ){
-          ptrdiff_t iglobal_request = (offsets_[itask] + sizes_[itask] + i) % g.n_[0];
-          if( iglobal_request >= g.local_0_start_ && iglobal_request < g.local_0_start_ + g.local_0_size_ ){
-            size_t ii = iglobal_request - g.local_0_start_;
-            MPI_Isend( &g.relem(ii*slicesz), slicesz, MPI::get_datatype<data_t>(), itask, iglobal_request, MPI_COMM_WORLD, &temp_req);
-            req.push_back(temp_req);
-          }
-        }
-      }
+#if defined(USE_MPI)
+    int finalized = 0;
+    MPI_Finalized(&finalized);
+    if( is_distributed_trait && !finalized ){
+      for( auto& req : requests_ ) MPI_Request_free(&req);
+      MPI_Comm_free(&neighbour_comm_);
+    }
+#endif
+  }
 
-      //--- receive data ------------------------------------------------------------
-      #pragma omp parallel if(CONFIG::MPI_threads_ok)
-      {
-          MPI_Status status;
-
-          #pragma omp for 
-          for( size_t i=0; i<num_ghosts; ++i ){
-            ptrdiff_t iglobal_request = (g.local_0_start_ + g.local_0_size_ + i) % g.n_[0];
-          
-            int recvfrom = get_task(iglobal_request);
-
-            //#pragma omp critical // need critical region here if we do "MPI_THREAD_FUNNELED", 
-            {
-                // receive data slice and check for MPI errors when in debug mode
-                status.MPI_ERROR = MPI_SUCCESS;
-                MPI_Recv(&boundary_right_[i*slicesz], (int)slicesz, MPI::get_datatype<data_t>(), recvfrom, (int)iglobal_request, MPI_COMM_WORLD, &status);
-                assert(status.MPI_ERROR == MPI_SUCCESS);
-            }
-          }
+#if defined(USE_MPI)
+  /// @brief determine the neighbours and set up persistent requests, one message per neighbour and direction
+  void setup_exchange( void )
+  {
+    const int ntasks = int(sizes_.size()), myrank = MPI::get_rank();
+    const size_t slicesz = ny_ * nzp_;
+
+    // ghost planes we need, grouped by the task that owns them; planes every task needs from us, in its slot order
+    std::vector<std::vector<size_t>> recv_slots(ntasks), send_planes(ntasks);
+    for( int islot=0; islot<2*num_ghosts; ++islot ){
+      if( !have_slot(islot) ) continue;
+      recv_slots[ get_task(get_ghost_plane(myrank, islot)) ].push_back( size_t(islot) );
+    }
+    for( int itask=0; itask<ntasks; ++itask ){
+      for( int islot=0; islot<2*num_ghosts; ++islot ){
+        if( !have_slot(islot) ) continue;
+        const ptrdiff_t iplane = get_ghost_plane(itask, islot);
+        if( get_task(iplane) == myrank ) send_planes[itask].push_back( size_t(iplane - gridref.local_0_start_) );
       }
     }
 
-    MPI_Barrier( MPI_COMM_WORLD );
-
-    if( have_left ){
-      for( int itask=0; itask<CONFIG::MPI_task_size; ++itask ){
-        for( size_t i=0; i<num_ghosts; ++i ){
-          ptrdiff_t iglobal_request = (offsets_[itask] + g.n_[0] - num_ghosts + i) % g.n_[0];
-          if( iglobal_request >= g.local_0_start_ && iglobal_request < g.local_0_start_ + g.local_0_size_ ){
-            size_t ii = iglobal_request - g.local_0_start_;
-            MPI_Isend( &g.relem(ii*slicesz), slicesz, MPI::get_datatype<data_t>(), itask, iglobal_request, MPI_COMM_WORLD, &temp_req);
-            req.push_back(temp_req);
-          }
-        }
+    for( int itask=0; itask<ntasks; ++itask ){
+      if( !recv_slots[itask].empty() ){
+        sources_.push_back(itask);
+        recv_slots_.push_back(recv_slots[itask]);
+        recvbuf_.push_back(std::vector<data_t>(recv_slots[itask].size() * slicesz));
       }
-
-      //--- receive data ------------------------------------------------------------
-      #pragma omp parallel if(CONFIG::MPI_threads_ok)
-      {
-          MPI_Status status;
-
-          #pragma omp for 
-          for( size_t i=0; i<num_ghosts; ++i ){
-            ptrdiff_t iglobal_request = (g.local_0_start_ + g.n_[0] - num_ghosts + i) % g.n_[0];
-          
-            int recvfrom = get_task(iglobal_request);
-
-            //#pragma omp critical // need critical region here if we do "MPI_THREAD_FUNNELED", 
-            {
-                // receive data slice and check for MPI errors when in debug mode
-                status.MPI_ERROR = MPI_SUCCESS;
-                MPI_Recv(&boundary_left_[i*slicesz], (int)slicesz, MPI::get_datatype<data_t>(), recvfrom, (int)iglobal_request, MPI_COMM_WORLD, &status);
-                assert(status.MPI_ERROR == MPI_SUCCESS);
-            }
-          }
+      if( !send_planes[itask].empty() ){
+        destinations_.push_back(itask);
+        send_planes_.push_back(send_planes[itask]);
+        sendbuf_.push_back(std::vector<data_t>(send_planes[itask].size() * slicesz));
       }
     }
 
-    MPI_Barrier( MPI_COMM_WORLD );
-    
-    for (size_t i = 0; i < req.size(); ++i)
-    {
-        // need to set status as wait does not necessarily modify it
-        // c.f. http://www.open-mpi.org/community/lists/devel/2007/04/1402.php
-        status.MPI_ERROR = MPI_SUCCESS;
-        // std::cout << "task " << CONFIG::MPI_task_rank << " : checking request No" << i << std::endl;
-        int flag(1);
-        MPI_Test(&req[i], &flag, &status);
-        if( !flag ){
-            std::cout << "task " << CONFIG::MPI_task_rank << " : request No" << i << " unsuccessful" << std::endl;
-        }
-
-        MPI_Wait(&req[i], &status);
-        // std::cout << "---> ok!" << std::endl;
-        assert(status.MPI_ERROR == MPI_SUCCESS);
+    // no reordering, so that ranks in the neighbour communicator are those in the grid communicator
+    MPI_Dist_graph_create_adjacent(MPI::get_comm(), int(sources_.size()), sources_.data(), MPI_UNWEIGHTED,
+                                   int(destinations_.size()), destinations_.data(), MPI_UNWEIGHTED,
+                                   MPI_INFO_NULL, 0, &neighbour_comm_);
+
+    requests_.assign(sources_.size() + destinations_.size(), MPI_REQUEST_NULL);
+    for( size_t i=0; i<sources_.size(); ++i ){
+      MPI_Recv_init(recvbuf_[i].data(), int(recvbuf_[i].size()), MPI::get_datatype<data_t>(), sources_[i], 0, neighbour_comm_, &requests_[i]);
+    }
+    for( size_t i=0; i<destinations_.size(); ++i ){
+      MPI_Send_init(sendbuf_[i].data(), int(sendbuf_[i].size()), MPI::get_datatype<data_t>(), destinations_[i], 0, neighbour_comm_, &requests_[sources_.size() + i]);
+    }
+  }
+#endif
+
+  /// @brief update ghost zones via MPI communication, ghost planes may come from several tasks
+  /// @param g grid to wrap
+  void update_ghosts_allow_multiple( const grid_t &g )
+  {
+  #if defined(USE_MPI)
+    assert( &g == &gridref );
+    const size_t slicesz = ny_ * nzp_;
+
+    //... pack boundary planes for all destinations
+    for( size_t i=0; i<destinations_.size(); ++i ){
+      #pragma omp parallel for
+      for( size_t l=0; l<send_planes_[i].size(); ++l ){
+        std::copy_n( &g.relem(send_planes_[i][l]*slicesz), slicesz, &sendbuf_[i][l*slicesz] );
+      }
     }
 
-    MPI_Barrier(MPI_COMM_WORLD);
-    
+    MPI_Startall( int(requests_.size()), requests_.data() );
+    MPI_Waitall( int(requests_.size()), requests_.data(), MPI_STATUSES_IGNORE );
+
+    //... unpack ghost planes
+    for( size_t i=0; i<sources_.size(); ++i ){
+      #pragma omp parallel for
+      for( size_t l=0; l<recv_slots_[i].size(); ++l ){
+        const size_t islot = recv_slots_[i][l];
+        data_t *dst = (islot < size_t(num_ghosts))? &boundary_left_[islot*slicesz] : &boundary_right_[(islot-num_ghosts)*slicesz];
+        std::copy_n( &recvbuf_[i][l*slicesz], slicesz, dst );
+      }
+    }
     #endif
   }
 
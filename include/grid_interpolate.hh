@@ -16,13 +16,75 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #pragma once
 
+#include <algorithm>
 #include <array>
+#include <cassert>
+#include <cmath>
 #include <vector>
 
 #include <general.hh>
 
 #include <math/vec3.hh>
 
+/// @brief mass assignment kernels of increasing order, grid points sit at integer positions (in grid units)
+/// @tparam order 0 (NGP), 1 (CIC), 2 (TSC), or 3 (PCS)
+template <int order>
+struct interpolation_kernel;
+
+template <>
+struct interpolation_kernel<0>
+{
+  //! fill the weights for position x, returns the first cell of the stencil
+  static inline ptrdiff_t weights(real_t x, std::array<real_t, 1> &w) noexcept
+  {
+    w[0] = 1.0;
+    return static_cast<ptrdiff_t>(std::floor(x));
+  }
+};
+
+template <>
+struct interpolation_kernel<1>
+{
+  static inline ptrdiff_t weights(real_t x, std::array<real_t, 2> &w) noexcept
+  {
+    const ptrdiff_t ix = static_cast<ptrdiff_t>(std::floor(x));
+    const real_t d = x - real_t(ix);
+    w[0] = 1.0 - d;
+    w[1] = d;
+    return ix;
+  }
+};
+
+template <>
+struct interpolation_kernel<2>
+{
+  static inline ptrdiff_t weights(real_t x, std::array<real_t, 3> &w) noexcept
+  {
+    // centred on the nearest grid point
+    const ptrdiff_t ic = static_cast<ptrdiff_t>(std::floor(x + 0.5));
+    const real_t d = x - real_t(ic);
+    w[0] = 0.5 * (0.5 - d) * (0.5 - d);
+    w[1] = 0.75 - d * d;
+    w[2] = 0.5 * (0.5 + d) * (0.5 + d);
+    return ic - 1;
+  }
+};
+
+template <>
+struct interpolation_kernel<3>
+{
+  static inline ptrdiff_t weights(real_t x, std::array<real_t, 4> &w) noexcept
+  {
+    const ptrdiff_t ix = static_cast<ptrdiff_t>(std::floor(x));
+    const real_t d = x - real_t(ix), d2 = d * d, d3 = d2 * d;
+    w[0] = (1.0 - d) * (1.0 - d) * (1.0 - d) / 6.0;
+    w[1] = (4.0 - 6.0 * d2 + 3.0 * d3) / 6.0;
+    w[2] = (1.0 + 3.0 * d + 3.0 * d2 - 3.0 * d3) / 6.0;
+    w[3] = d3 / 6.0;
+    return ix - 1;
+  }
+};
+
 template <int interp_order, typename grid_t>
 struct grid_interpolate
 {
@@ -31,128 +93,332 @@ struct grid_interpolate
 
   static constexpr bool is_distributed_trait = grid_t::is_distributed_trait;
   static constexpr int interpolation_order = interp_order;
+  static constexpr int stencil_size = interp_order + 1;
+
+  //! minimum number of ghost planes needed by the kernel below and above the local slab
+  static constexpr int kernel_ghost_left = interp_order / 2;
+  static constexpr int kernel_ghost_right = (interp_order == 0) ? 0 : (interp_order + 2) / 2;
 
-  std::vector<data_t> boundary_;
+  //! number of particles interpolated together in the batched interface
+  static constexpr size_t block_size = 64;
+
+  //! first cell and kernel weights of a particle along each dimension
+  struct stencil_t
+  {
+    std::array<ptrdiff_t, 3> i0;
+    std::array<std::array<real_t, stencil_size>, 3> w;
+  };
+
+  std::vector<data_t> ghost_left_, ghost_right_;
+  std::vector<const data_t *> planes_; //!< local and ghost x-planes, planes_[ix+nghost_left_] for local index ix
   std::vector<int> local0starts_;
   const grid_t &gridref;
-  size_t nx_, ny_, nz_;
+  const data_t *bound_data_; //!< storage of gridref that planes_ and the persistent requests refer to
+  size_t nx_, ny_, nz_, nzp_;
+  int nghost_left_, nghost_right_;
+
+#if defined(USE_MPI)
+  std::vector<MPI_Request> requests_; //!< persistent requests of the halo exchange
+#endif
 
-  explicit grid_interpolate(const grid_t &g)
-      : gridref(g), nx_(g.n_[0]), ny_(g.n_[1]), nz_(g.n_[2])
+  /// @brief construct interpolator for a (possibly slab distributed) grid
+  ///
+  /// the plane table and the persistent halo requests point into the grid's storage; if the grid is
+  /// reallocated, they are rebuilt by the next ghost update, which has to precede any interpolation
+  /// @param g grid to interpolate, its data may change between ghost updates
+  /// @param ghost_width number of ghost planes on either side, at least what the kernel needs
+  explicit grid_interpolate(const grid_t &g, int ghost_width = 0)
+      : gridref(g), bound_data_(g.data_), nx_(g.n_[0]), ny_(g.n_[1]), nz_(g.n_[2]), nzp_(g.npr_),
+        nghost_left_(is_distributed_trait ? std::max(ghost_width, kernel_ghost_left) : kernel_ghost_left),
+        nghost_right_(is_distributed_trait ? std::max(ghost_width, kernel_ghost_right) : kernel_ghost_right)
   {
-    static_assert(interpolation_order >= 0 && interpolation_order <= 2, "Interpolation order needs to be 0 (NGP), 1 (CIC), or 2 (TSC).");
+    static_assert(interpolation_order >= 0 && interpolation_order <= 3, "Interpolation order needs to be 0 (NGP), 1 (CIC), 2 (TSC), or 3 (PCS).");
 
     if (is_distributed_trait)
     {
-      // this is broken currently, ghost zone update needs to be re-implemented
-      // since it is only used for GLASS ICs, these will be disabled.
-      //DISABLED://  update_ghosts( g );
+      // all tasks have to fail together, otherwise the others block in the halo exchange
+      int too_wide = (gridref.local_0_size_ < std::max(nghost_left_, nghost_right_)) ? 1 : 0;
+#if defined(USE_MPI)
+      int too_wide_local = too_wide;
+      MPI_Allreduce(&too_wide_local, &too_wide, 1, MPI_INT, MPI_MAX, MPI::get_comm());
+#endif
+      if (too_wide)
+      {
+        music::elog << "Ghost zone of " << std::max(nghost_left_, nghost_right_) << " planes is wider than the local slab on some task (here "
+                    << gridref.local_0_size_ << " planes)!" << std::endl;
+        throw std::runtime_error("ghost zone is wider than the local slab");
+      }
+      // ghost zones are filled only by update_ghosts, once the field holds the data to interpolate
+      ghost_left_.assign(nghost_left_ * ny_ * nzp_, data_t{0.0});
+      ghost_right_.assign(nghost_right_ * ny_ * nzp_, data_t{0.0});
 
+#if defined(USE_MPI)
+      int local_0_start = int(gridref.local_0_start_);
+      local0starts_.assign(MPI::get_size(), 0);
+      MPI_Allgather(&local_0_start, 1, MPI_INT, &local0starts_[0], 1, MPI_INT, MPI::get_comm());
+#endif
+      this->init_halo_exchange();
     }
+    this->set_planes();
   }
 
-  void update_ghosts( const grid_t &g )
+  // persistent requests refer to our buffers, so the object must not be copied
+  grid_interpolate(const grid_interpolate &) = delete;
+  grid_interpolate &operator=(const grid_interpolate &) = delete;
+
+  ~grid_interpolate()
   {
-  #if defined(USE_MPI)
+#if defined(USE_MPI)
+    int finalized = 0;
+    MPI_Finalized(&finalized);
+    if (!finalized)
+      this->free_halo_exchange();
+#endif
+  }
 
-    int local_0_start = int(gridref.local_0_start_);
-    local0starts_.assign(MPI::get_size(), 0);
+  //! rebuild the plane table and the persistent requests if the grid has been reallocated since they were set up
+  void rebind( void )
+  {
+    if (bound_data_ == gridref.data_)
+      return;
+    bound_data_ = gridref.data_;
+    if (is_distributed_trait)
+    {
+      this->free_halo_exchange();
+      this->init_halo_exchange();
+    }
+    this->set_planes();
+  }
 
-    MPI_Allgather(&local_0_start, 1, MPI_INT, &local0starts_[0], 1, MPI_INT, MPI_COMM_WORLD);
+  //! set up the table of plane pointers, ghost planes wrap periodically onto the grid itself if not distributed
+  void set_planes( void )
+  {
+    const ptrdiff_t nlocal = gridref.local_0_size_;
+    planes_.assign(nlocal + nghost_left_ + nghost_right_, nullptr);
 
-    //... exchange boundary
-    size_t nx = interpolation_order + 1;
-    size_t ny = g.n_[1];
-    size_t nz = g.n_[2];
+    for (ptrdiff_t i = -nghost_left_; i < nlocal + nghost_right_; ++i)
+    {
+      const data_t *p;
+      if (i >= 0 && i < nlocal)
+        p = &gridref.data_[size_t(i) * ny_ * nzp_];
+      else if (!is_distributed_trait)
+        p = &gridref.data_[size_t((i + ptrdiff_t(nx_)) % ptrdiff_t(nx_)) * ny_ * nzp_];
+      else if (i < 0)
+        p = &ghost_left_[size_t(i + nghost_left_) * ny_ * nzp_];
+      else
+        p = &ghost_right_[size_t(i - nlocal) * ny_ * nzp_];
+      planes_[i + nghost_left_] = p;
+    }
+  }
 
-    boundary_.assign(nx * ny * nz, data_t{0.0});
+  //! set up the persistent neighbour exchange, boundary planes are contiguous in memory and sent in place
+  //! (this involves no communication, so tasks can rebind independently)
+  void init_halo_exchange( void )
+  {
+#if defined(USE_MPI)
+    const size_t planesz = ny_ * nzp_;
+    const int left = (MPI::get_rank() + MPI::get_size() - 1) % MPI::get_size();
+    const int right = (MPI::get_rank() + MPI::get_size() + 1) % MPI::get_size();
+    enum { tag_to_left = 101, tag_to_right = 102 };
 
-    for (size_t i = 0; i < nx; ++i)
+    requests_.clear();
+    if (nghost_right_ > 0)
     {
-      for (size_t j = 0; j < ny; ++j)
-      {
-        for (size_t k = 0; k < nz; ++k)
-        {
-          boundary_[(i * ny + j) * nz + k] = g.relem(i, j, k);
-        }
-      }
+      // first planes go to the left neighbour, which uses them as its right ghosts
+      requests_.push_back(MPI_REQUEST_NULL);
+      MPI_Recv_init(&ghost_right_[0], int(nghost_right_ * planesz), MPI::get_datatype<data_t>(), right, tag_to_left, MPI::get_comm(), &requests_.back());
+      requests_.push_back(MPI_REQUEST_NULL);
+      MPI_Send_init(&gridref.data_[0], int(nghost_right_ * planesz), MPI::get_datatype<data_t>(), left, tag_to_left, MPI::get_comm(), &requests_.back());
     }
+    if (nghost_left_ > 0)
+    {
+      // last planes go to the right neighbour, which uses them as its left ghosts
+      requests_.push_back(MPI_REQUEST_NULL);
+      MPI_Recv_init(&ghost_left_[0], int(nghost_left_ * planesz), MPI::get_datatype<data_t>(), left, tag_to_right, MPI::get_comm(), &requests_.back());
+      requests_.push_back(MPI_REQUEST_NULL);
+      MPI_Send_init(&gridref.data_[(gridref.local_0_size_ - nghost_left_) * planesz], int(nghost_left_ * planesz), MPI::get_datatype<data_t>(), right, tag_to_right, MPI::get_comm(), &requests_.back());
+    }
+#endif
+  }
 
-    int sendto = (MPI::get_rank() + MPI::get_size() - 1) % MPI::get_size();
-    int recvfrom = (MPI::get_rank() + MPI::get_size() + 1) % MPI::get_size();
-
-    MPI_Status status;
-    status.MPI_ERROR = MPI_SUCCESS;
+  //! release the persistent requests of the neighbour exchange
+  void free_halo_exchange( void )
+  {
+#if defined(USE_MPI)
+    for (auto &req : requests_)
+      MPI_Request_free(&req);
+    requests_.clear();
+#endif
+  }
 
-    int err = MPI_Sendrecv_replace(&boundary_[0], nx * ny * nz, MPI::get_datatype<data_t>(), sendto,
-                          MPI::get_rank() + 1000, recvfrom, recvfrom + 1000, MPI_COMM_WORLD, &status);
+  //! start the exchange of the ghost zones, the grid must not be modified until it is finished
+  void start_ghost_update( void )
+  {
+    this->rebind();
+#if defined(USE_MPI)
+    if (!requests_.empty())
+      MPI_Startall(int(requests_.size()), &requests_[0]);
+#endif
+  }
 
-    if( err != MPI_SUCCESS ){
-      char errstr[256]; int errlen=256;
-      MPI_Error_string(err, errstr, &errlen ); 
-      music::elog << "MPI_ERROR #" << err << " : " << errstr << std::endl;
+  //! wait until the ghost zones are filled
+  void finish_ghost_update( void )
+  {
+#if defined(USE_MPI)
+    if (!requests_.empty())
+    {
+      int err = MPI_Waitall(int(requests_.size()), &requests_[0], MPI_STATUSES_IGNORE);
+      if( err != MPI_SUCCESS ){
+        char errstr[256]; int errlen=256;
+        MPI_Error_string(err, errstr, &errlen ); 
+        music::elog << "MPI_ERROR #" << err << " : " << errstr << std::endl;
+      }
     }
 #endif
   }
 
-  data_t get_ngp_at(const std::array<real_t, 3> &pos, std::vector<data_t> &val) const noexcept
+  void update_ghosts( const grid_t &g )
   {
-    size_t ix = static_cast<size_t>(pos[0]);
-    size_t iy = static_cast<size_t>(pos[1]);
-    size_t iz = static_cast<size_t>(pos[2]);
-    return gridref.relem(ix - gridref.local_0_start_, iy, iz);
+    assert(&g == &gridref);
+    this->start_ghost_update();
+    this->finish_ghost_update();
   }
 
-  data_t get_cic_at(const std::array<real_t, 3> &pos) const noexcept
+  //! true if the stencil only touches planes of the local slab (always true if not distributed)
+  bool is_interior(const stencil_t &s) const noexcept
   {
-    size_t ix = static_cast<size_t>(pos[0]);
-    size_t iy = static_cast<size_t>(pos[1]);
-    size_t iz = static_cast<size_t>(pos[2]);
-    real_t dx = pos[0] - real_t(ix), tx = 1.0 - dx;
-    real_t dy = pos[1] - real_t(iy), ty = 1.0 - dy;
-    real_t dz = pos[2] - real_t(iz), tz = 1.0 - dz;
-    size_t iy1 = (iy + 1) % ny_;
-    size_t iz1 = (iz + 1) % nz_;
+    return !is_distributed_trait || (s.i0[0] >= 0 && s.i0[0] + stencil_size <= gridref.local_0_size_);
+  }
+
+  //! compute the stencil of a particle at global position pos (in grid units), x index is local to the slab
+  stencil_t get_stencil(const vec3 &pos) const noexcept
+  {
+    stencil_t s;
+    for (int idim = 0; idim < 3; ++idim)
+    {
+      s.i0[idim] = interpolation_kernel<interpolation_order>::weights(pos[idim], s.w[idim]);
+    }
+    s.i0[0] -= gridref.local_0_start_;
+    return s;
+  }
+
+  //! interpolate the field with a precomputed stencil
+  data_t get_at(const stencil_t &s) const noexcept
+  {
+    assert(bound_data_ == gridref.data_);
+    std::array<size_t, stencil_size> iy, iz;
+    for (int l = 0; l < stencil_size; ++l)
+    {
+      iy[l] = size_t((s.i0[1] + l + ptrdiff_t(ny_)) % ptrdiff_t(ny_)) * nzp_;
+      iz[l] = size_t((s.i0[2] + l + ptrdiff_t(nz_)) % ptrdiff_t(nz_));
+    }
 
     data_t val{0.0};
-    
-    if( is_distributed_trait ){
-      ptrdiff_t localix = ix-gridref.local_0_start_;
-      val += gridref.relem(localix, iy, iz) * tx * ty * tz;
-      val += gridref.relem(localix, iy, iz1) * tx * ty * dz;
-      val += gridref.relem(localix, iy1, iz) * tx * dy * tz;
-      val += gridref.relem(localix, iy1, iz1) * tx * dy * dz;
-
-      if( localix+1 >= gridref.local_0_size_ ){
-        size_t localix1 = localix+1 - gridref.local_0_size_;
-        val += boundary_[(localix1*ny_+iy)*nz_+iz] * dx * ty * tz;
-        val += boundary_[(localix1*ny_+iy)*nz_+iz1] * dx * ty * dz;
-        val += boundary_[(localix1*ny_+iy1)*nz_+iz] * dx * dy * tz;
-        val += boundary_[(localix1*ny_+iy1)*nz_+iz1] * dx * dy * dz;
-      }else{
-        size_t localix1 = localix+1;
-        val += gridref.relem(localix1, iy, iz) * dx * ty * tz;
-        val += gridref.relem(localix1, iy, iz1) * dx * ty * dz;
-        val += gridref.relem(localix1, iy1, iz) * dx * dy * tz;
-        val += gridref.relem(localix1, iy1, iz1) * dx * dy * dz;
+    for (int a = 0; a < stencil_size; ++a)
+    {
+      const data_t *plane = planes_[s.i0[0] + a + nghost_left_];
+      for (int b = 0; b < stencil_size; ++b)
+      {
+        const real_t wab = s.w[0][a] * s.w[1][b];
+        const data_t *row = plane + iy[b];
+        for (int c = 0; c < stencil_size; ++c)
+        {
+          val += row[iz[c]] * (wab * s.w[2][c]);
+        }
       }
-    }else{
-      size_t ix1 = (ix + 1) % nx_;
-      val += gridref.relem(ix, iy, iz) * tx * ty * tz;
-      val += gridref.relem(ix, iy, iz1) * tx * ty * dz;
-      val += gridref.relem(ix, iy1, iz) * tx * dy * tz;
-      val += gridref.relem(ix, iy1, iz1) * tx * dy * dz;
-      val += gridref.relem(ix1, iy, iz) * dx * ty * tz;
-      val += gridref.relem(ix1, iy, iz1) * dx * ty * dz;
-      val += gridref.relem(ix1, iy1, iz) * dx * dy * tz;
-      val += gridref.relem(ix1, iy1, iz1) * dx * dy * dz;
     }
     return val;
   }
 
-  // data_t get_tsc_at(const std::array<real_t, 3> &pos, std::vector<data_t> &val) const
-  // {
-  // }
+  //! interpolate the field at a single position (in grid units)
+  data_t get_at(const vec3 &pos) const noexcept
+  {
+    return this->get_at(this->get_stencil(pos));
+  }
+
+  /// @brief interpolate the field at a block of at most block_size positions
+  /// @param interior_only if true, nothing is done and false is returned if any particle needs ghost planes
+  bool get_at_block(const vec3 *pos, size_t nb, data_t *val, bool interior_only) const noexcept
+  {
+    assert(bound_data_ == gridref.data_);
+    std::array<stencil_t, block_size> s;
+    std::array<size_t, block_size> ioff;
+
+    for (size_t p = 0; p < nb; ++p)
+    {
+      s[p] = this->get_stencil(pos[p]);
+      if (interior_only && !this->is_interior(s[p]))
+        return false;
+    }
+
+    for (size_t p = 0; p < nb; ++p)
+    {
+      val[p] = data_t{0.0};
+    }
+
+    // loop over the stencil outside, so that the inner loop over particles is a plain gather
+    for (int b = 0; b < stencil_size; ++b)
+    {
+      for (int c = 0; c < stencil_size; ++c)
+      {
+        for (size_t p = 0; p < nb; ++p)
+        {
+          ioff[p] = size_t((s[p].i0[1] + b + ptrdiff_t(ny_)) % ptrdiff_t(ny_)) * nzp_ + size_t((s[p].i0[2] + c + ptrdiff_t(nz_)) % ptrdiff_t(nz_));
+        }
+        for (int a = 0; a < stencil_size; ++a)
+        {
+          #pragma omp simd
+          for (size_t p = 0; p < nb; ++p)
+          {
+            val[p] += planes_[s[p].i0[0] + a + nghost_left_][ioff[p]] * (s[p].w[0][a] * s[p].w[1][b] * s[p].w[2][c]);
+          }
+        }
+      }
+    }
+    return true;
+  }
+
+  /// @brief interpolate the field at a batch of positions, with the current ghost zones
+  /// @param pos positions in grid units, must lie in the local slab if distributed
+  /// @param np number of positions
+  /// @param val output array of np values
+  void get_at(const vec3 *pos, size_t np, data_t *val) const noexcept
+  {
+    #pragma omp parallel for schedule(static)
+    for (size_t ib = 0; ib < np; ib += block_size)
+    {
+      this->get_at_block(&pos[ib], std::min(block_size, np - ib), &val[ib], false);
+    }
+  }
+
+  /// @brief update the ghost zones and interpolate the field at a batch of positions
+  ///
+  /// blocks of particles away from the slab boundaries are interpolated while the ghost zones are
+  /// in flight, only the remaining blocks wait for the exchange to finish
+  void interpolate(const vec3 *pos, size_t np, data_t *val)
+  {
+    const size_t nblocks = (np + block_size - 1) / block_size;
+    std::vector<char> bdeferred(nblocks, 0);
+
+    this->start_ghost_update();
+
+    #pragma omp parallel for schedule(static)
+    for (size_t iblock = 0; iblock < nblocks; ++iblock)
+    {
+      const size_t ib = iblock * block_size;
+      bdeferred[iblock] = !this->get_at_block(&pos[ib], std::min(block_size, np - ib), &val[ib], true);
+    }
+
+    this->finish_ghost_update();
+
+    #pragma omp parallel for schedule(dynamic)
+    for (size_t iblock = 0; iblock < nblocks; ++iblock)
+    {
+      if (!bdeferred[iblock]) continue;
+      const size_t ib = iblock * block_size;
+      this->get_at_block(&pos[ib], std::min(block_size, np - ib), &val[ib], false);
+    }
+  }
 
   int get_task(const vec3 &x) const noexcept
   {
@@ -173,7 +439,7 @@ struct grid_interpolate
         sendcounts[this->get_task(x)] += 3;
       }
 
-      MPI_Alltoall(&sendcounts[0], 1, MPI_INT, &recvcounts[0], 1, MPI_INT, MPI_COMM_WORLD);
+      MPI_Alltoall(&sendcounts[0], 1, MPI_INT, &recvcounts[0], 1, MPI_INT, MPI::get_comm());
 
       size_t tot_receive = recvcounts[0];
 //      size_t tot_send = sendcounts[0];
@@ -188,22 +454,23 @@ struct grid_interpolate
       std::vector<vec3> recvbuf(tot_receive/3,{0.,0.,0.});
 
       MPI_Alltoallv(&pos[0], &sendcounts[0], &sendoffsets[0], MPI::get_datatype<real_t>(),
-                    &recvbuf[0], &recvcounts[0], &recvoffsets[0], MPI::get_datatype<real_t>(), MPI_COMM_WORLD);
+                    &recvbuf[0], &recvcounts[0], &recvoffsets[0], MPI::get_datatype<real_t>(), MPI::get_comm());
 
       pos.swap( recvbuf );
 #endif
     }
   }
 
-  ccomplex_t compensation_kernel( const vec3_t<real_t>& k ) const noexcept
+  /// @brief deconvolution kernel of the interpolation along one axis, the full kernel is the product over the three
+  ///        axes, so that it can be tabulated per axis
+  /// @param idim axis
+  /// @param k wave number along the axis
+  ccomplex_t compensation_kernel_1d( int idim, real_t k ) const noexcept
   {
     auto sinc = []( real_t x ){ return (std::fabs(x)>1e-10)? std::sin(x)/x : 1.0; };
-    real_t dfx = sinc(0.5*M_PI*k[0]/gridref.kny_[0]);
-    real_t dfy = sinc(0.5*M_PI*k[1]/gridref.kny_[1]);
-    real_t dfz = sinc(0.5*M_PI*k[2]/gridref.kny_[2]);
-    real_t del = std::pow(dfx*dfy*dfz,1+interpolation_order);
+    real_t del = std::pow(sinc(0.5*M_PI*k/gridref.kny_[idim]),1+interpolation_order);
 
-    real_t shift = 0.5 * k[0] * gridref.get_dx()[0] + 0.5 * k[1] * gridref.get_dx()[1] + 0.5 * k[2] * gridref.get_dx()[2];
+    real_t shift = 0.5 * k * gridref.get_dx()[idim];
 
     return std::exp(ccomplex_t(0.0, shift)) / del;
   }
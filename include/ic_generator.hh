@@ -17,6 +17,7 @@
 #pragma once
 
 #include <memory>
+#include <string>
 
 #include <config_file.hh>
 #include <random_plugin.hh>
@@ -31,6 +32,9 @@ namespace ic_generator{
 
     void reset();
 
+    //! insert a suffix into a file name, before the extension if there is one
+    std::string suffixed_filename( const std::string& fname, const std::string& suffix );
+
     extern std::unique_ptr<RNG_plugin> the_random_number_generator;
     extern std::unique_ptr<output_plugin> the_output_plugin;
     extern std::unique_ptr<cosmology::calculator>  the_cosmo_calc;
@@ -0,0 +1,310 @@
+// This file is part of monofonIC (MUSIC2)
+// A software package to generate ICs for cosmological simulations
+// Copyright (C) 2020 by Oliver Hahn
+//
+// monofonIC is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// monofonIC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <type_traits>
+#include <vector>
+
+#include <general.hh>
+#include <grid_fft.hh>
+
+/*!
+ * @brief k-space kernels combining the LPT potentials into displacement and velocity fields
+ *
+ * The LPT order, the glass interpolation compensation, the baryon relative velocity correction and
+ * the storage of A(3) in transverse form are template parameters, and the gradient operator (plain
+ * Fourier or PLT) is a template type, so that the mode loops carry no runtime branches or virtual
+ * calls. dispatch() selects the specialisation once per field.
+ */
+namespace lpt_kernels
+{
+
+/// @brief the LPT potentials, phi2, phi3 and A3 are only accessed if the order requires them
+struct potentials_t
+{
+    const Grid_FFT<real_t> &phi, &phi2, &phi3;
+    const std::array<Grid_FFT<real_t> *, 3> &A3; //!< in transverse form (kernel parameter btransverse), A3[0], A3[1] hold
+                                                 //!< the components along the transverse basis and A3[2] is unused
+};
+
+/// @brief separable k-space kernel tabulated per axis on the global mode indices of a grid, evaluated in the
+/// mode loops as the product of three table entries (used for the glass interpolation compensation)
+struct separable_kernel_t
+{
+    std::array<std::vector<ccomplex_t>, 3> tab;
+
+    separable_kernel_t() = default;
+
+    /// @param g grid whose wave numbers are tabulated
+    /// @param kernel1d functor (idim, k) returning the factor of axis idim for wave number k
+    template <typename kernel1d_t>
+    separable_kernel_t(const Grid_FFT<real_t> &g, const kernel1d_t &kernel1d)
+    {
+        for (int d = 0; d < 3; ++d)
+        {
+            tab[d].resize(g.n_[d]);
+            for (size_t m = 0; m < g.n_[d]; ++m)
+                tab[d][m] = kernel1d(d, g.ktab_[d][m]);
+        }
+    }
+
+    inline ccomplex_t operator()(const std::array<size_t, 3> &k3) const noexcept
+    {
+        return tab[0][k3[0]] * tab[1][k3[1]] * tab[2][k3[2]];
+    }
+};
+
+/// @brief orthonormal basis (e1,e2) of the plane perpendicular to k, such that (e1,e2,k/|k|) is right handed
+/// e1 is built from the coordinate axis least aligned with k; any basis works, it only has to be the same
+/// when A3 is compressed and expanded
+inline void transverse_basis(const vec3_t<real_t> &k, vec3_t<real_t> &e1, vec3_t<real_t> &e2)
+{
+    const real_t knorm = k.norm();
+    if (knorm == real_t(0))
+    {
+        e1 = vec3_t<real_t>(1, 0, 0);
+        e2 = vec3_t<real_t>(0, 1, 0);
+        return;
+    }
+    const vec3_t<real_t> kh = k / knorm;
+    const real_t ax = std::fabs(kh.x), ay = std::fabs(kh.y), az = std::fabs(kh.z);
+    vec3_t<real_t> a = (ax <= ay && ax <= az) ? vec3_t<real_t>(1, 0, 0) : ((ay <= az) ? vec3_t<real_t>(0, 1, 0) : vec3_t<real_t>(0, 0, 1));
+    e1 = a - kh * a.dot(kh);
+    e1 /= e1.norm();
+    e2 = vec3_t<real_t>(kh.y * e1.z - kh.z * e1.y, kh.z * e1.x - kh.x * e1.z, kh.x * e1.y - kh.y * e1.x);
+}
+
+/// @brief store a divergence-free k-space field (a0,a1,a2) as its two components along the transverse basis
+/// of each mode, in a0 and a1; the longitudinal part is dropped (it does not contribute to the curl), a2
+/// is only read and can be released afterwards
+inline void compress_transverse(Grid_FFT<real_t> &a0, Grid_FFT<real_t> &a1, const Grid_FFT<real_t> &a2)
+{
+    omp_loops::parallel_for_2d(a0.size(0), a0.size(1), [&](size_t i, size_t j) {
+        for (size_t k = 0; k < a0.size(2); ++k)
+        {
+            vec3_t<real_t> e1, e2;
+            transverse_basis(a0.template get_k<real_t>(i, j, k), e1, e2);
+            const size_t idx = a0.get_idx(i, j, k);
+            const ccomplex_t A0 = a0.kelem(idx), A1 = a1.kelem(idx), A2 = a2.kelem(idx);
+            a0.kelem(idx) = e1.x * A0 + e1.y * A1 + e1.z * A2;
+            a1.kelem(idx) = e2.x * A0 + e2.y * A1 + e2.z * A2;
+        }
+    });
+}
+
+/// @brief inverse of compress_transverse, restores all three components of the field into a0, a1, a2
+inline void expand_transverse(Grid_FFT<real_t> &a0, Grid_FFT<real_t> &a1, Grid_FFT<real_t> &a2)
+{
+    omp_loops::parallel_for_2d(a0.size(0), a0.size(1), [&](size_t i, size_t j) {
+        for (size_t k = 0; k < a0.size(2); ++k)
+        {
+            vec3_t<real_t> e1, e2;
+            transverse_basis(a0.template get_k<real_t>(i, j, k), e1, e2);
+            const size_t idx = a0.get_idx(i, j, k);
+            const ccomplex_t c1 = a0.kelem(idx), c2 = a1.kelem(idx);
+            a0.kelem(idx) = e1.x * c1 + e2.x * c2;
+            a1.kelem(idx) = e1.y * c1 + e2.y * c2;
+            a2.kelem(idx) = e1.z * c1 + e2.z * c2;
+        }
+    });
+}
+
+/// @brief components idimp and idimpp of the transverse basis for a block of modes of one row, computed
+/// ahead of the mode loop so that the loop itself carries no branches or square roots
+struct transverse_block_t
+{
+    static constexpr size_t size = 64;
+    std::array<real_t, size> e1p, e2p, e1pp, e2pp;
+
+    //! fill the basis for modes k0..k0+nb-1 of row (i,j) of grid g
+    void fill(const Grid_FFT<real_t> &g, size_t i, size_t j, size_t k0, size_t nb, int idimp, int idimpp)
+    {
+        for (size_t l = 0; l < nb; ++l)
+        {
+            vec3_t<real_t> e1, e2;
+            transverse_basis(g.template get_k<real_t>(i, j, k0 + l), e1, e2);
+            e1p[l] = e1[idimp];
+            e2p[l] = e2[idimp];
+            e1pp[l] = e1[idimpp];
+            e2pp[l] = e2[idimpp];
+        }
+    }
+};
+
+/// @brief component idim of curl(A3) for one mode, from the two components of A3 it needs (Ap along idimp,
+/// App along idimpp), or in transverse form (btransverse) from the components c1, c2 along the basis of the
+/// mode, which is entry l of tb
+template <bool btransverse, typename gradient_t, typename k3_t>
+inline ccomplex_t curl_A3(const gradient_t &lg, const k3_t &k3, const int idimp, const int idimpp,
+                          const transverse_block_t &tb, const size_t l, ccomplex_t Ap, ccomplex_t App)
+{
+    if (btransverse)
+    {
+        const ccomplex_t c1 = Ap, c2 = App;
+        Ap = tb.e1p[l] * c1 + tb.e2p[l] * c2;
+        App = tb.e1pp[l] * c1 + tb.e2pp[l] * c2;
+    }
+    return lg.gradient(idimp, k3) * App - lg.gradient(idimpp, k3) * Ap;
+}
+
+/// @brief call f(order, bglass, bbaryons, btransverse) for 3LPT, A3 is only read there
+template <typename F, typename G, typename B>
+inline void dispatch_transverse(std::integral_constant<int, 3> o, bool btransverse, F &f, G bglass, B bbaryons)
+{
+    if (btransverse) f(o, bglass, bbaryons, std::true_type());
+    else f(o, bglass, bbaryons, std::false_type());
+}
+
+template <int order, typename F, typename G, typename B>
+inline void dispatch_transverse(std::integral_constant<int, order> o, bool, F &f, G bglass, B bbaryons)
+{
+    f(o, bglass, bbaryons, std::false_type());
+}
+
+/// @brief call f(order, bglass, bbaryons, btransverse) with std::integral_constant arguments for the runtime values
+template <int order, typename F>
+inline void dispatch_flags(bool bglass, bool bbaryons, bool btransverse, F &f)
+{
+    using T = std::true_type;
+    using N = std::false_type;
+    const std::integral_constant<int, order> o;
+    if (bglass)
+    {
+        if (bbaryons) dispatch_transverse(o, btransverse, f, T(), T());
+        else dispatch_transverse(o, btransverse, f, T(), N());
+    }
+    else
+    {
+        if (bbaryons) dispatch_transverse(o, btransverse, f, N(), T());
+        else dispatch_transverse(o, btransverse, f, N(), N());
+    }
+}
+
+/// @param btransverse A3 is stored as its two components along the transverse basis (see compress_transverse)
+template <typename F>
+inline void dispatch(int LPTorder, bool bglass, bool bbaryons, bool btransverse, F &&f)
+{
+    if (LPTorder > 2)
+        dispatch_flags<3>(bglass, bbaryons, btransverse, f);
+    else if (LPTorder > 1)
+        dispatch_flags<2>(bglass, bbaryons, btransverse, f);
+    else
+        dispatch_flags<1>(bglass, bbaryons, btransverse, f);
+}
+
+/// @brief displacement along idim: grad(phi1+phi2+phi3) + curl(A3), times fac
+/// @param compensation functor returning the interpolation compensation kernel for the global mode index (glass loads),
+///        e.g. a separable_kernel_t
+template <int order, bool bglass, bool btransverse, typename gradient_t, typename compensation_t>
+void displacement(Grid_FFT<real_t> &out, const int idim, const potentials_t &p, const gradient_t &lg,
+                  const compensation_t &compensation, const real_t fac)
+{
+    const int idimp = (idim + 1) % 3, idimpp = (idim + 2) % 3;
+
+    omp_loops::parallel_for_2d(out.size(0), out.size(1), [&](size_t i, size_t j) {
+        const size_t idx0 = out.get_idx(i, j, 0);
+        ccomplex_t *pout = &out.kelem(idx0);
+        const ccomplex_t *pphi1 = &p.phi.kelem(idx0);
+        const ccomplex_t *pphi2 = (order > 1) ? &p.phi2.kelem(idx0) : nullptr;
+        const ccomplex_t *pphi3 = (order > 2) ? &p.phi3.kelem(idx0) : nullptr;
+        const ccomplex_t *pA3p  = (order > 2) ? &p.A3[btransverse ? 0 : idimp]->kelem(idx0) : nullptr;
+        const ccomplex_t *pA3pp = (order > 2) ? &p.A3[btransverse ? 1 : idimpp]->kelem(idx0) : nullptr;
+
+        transverse_block_t tb;
+        for (size_t kb = 0; kb < out.size(2); kb += transverse_block_t::size)
+        {
+            const size_t kend = std::min(kb + transverse_block_t::size, out.size(2));
+            if (order > 2 && btransverse) tb.fill(out, i, j, kb, kend - kb, idimp, idimpp);
+
+            #pragma omp simd
+            for (size_t k = kb; k < kend; ++k)
+            {
+                const auto k3 = out.get_k3(i, j, k);
+                ccomplex_t phitot = pphi1[k];
+                if (order > 1) phitot += pphi2[k];
+                if (order > 2) phitot += pphi3[k];
+
+                ccomplex_t val = lg.gradient(idim, k3) * phitot;
+                if (order > 2) val += curl_A3<btransverse>(lg, k3, idimp, idimpp, tb, k - kb, pA3p[k], pA3pp[k]);
+                if (bglass) val *= compensation(k3);
+
+                pout[k] = val * fac;
+            }
+        }
+    });
+}
+
+/// @brief velocity along idim: grad(vfac1 phi1 + vfac2 phi2 + vfac3 phi3) + vfac3 curl(A3), times fac
+/// @param vfac growth rate factors of the three orders
+/// @param wnoise white noise field, for the baryon-CDM relative velocity correction
+/// @param theta_bc functor returning C_species * vfac1 * theta_bc amplitude for a wave number (baryons only)
+template <int order, bool bglass, bool bbaryons, bool btransverse, typename gradient_t, typename compensation_t, typename theta_bc_t>
+void velocity(Grid_FFT<real_t> &out, const int idim, const potentials_t &p, const std::array<real_t, 3> &vfac,
+              const Grid_FFT<real_t> &wnoise, const theta_bc_t &theta_bc, const gradient_t &lg,
+              const compensation_t &compensation, const real_t fac)
+{
+    const int idimp = (idim + 1) % 3, idimpp = (idim + 2) % 3;
+
+    omp_loops::parallel_for_2d(out.size(0), out.size(1), [&](size_t i, size_t j) {
+        const size_t idx0 = out.get_idx(i, j, 0);
+        ccomplex_t *pout = &out.kelem(idx0);
+        const ccomplex_t *pphi1 = &p.phi.kelem(idx0);
+        const ccomplex_t *pphi2 = (order > 1) ? &p.phi2.kelem(idx0) : nullptr;
+        const ccomplex_t *pphi3 = (order > 2) ? &p.phi3.kelem(idx0) : nullptr;
+        const ccomplex_t *pA3p  = (order > 2) ? &p.A3[btransverse ? 0 : idimp]->kelem(idx0) : nullptr;
+        const ccomplex_t *pA3pp = (order > 2) ? &p.A3[btransverse ? 1 : idimpp]->kelem(idx0) : nullptr;
+        const ccomplex_t *pwn   = bbaryons ? &wnoise.kelem(idx0) : nullptr;
+
+        transverse_block_t tb;
+        for (size_t kb = 0; kb < out.size(2); kb += transverse_block_t::size)
+        {
+            const size_t kend = std::min(kb + transverse_block_t::size, out.size(2));
+            if (order > 2 && btransverse) tb.fill(out, i, j, kb, kend - kb, idimp, idimpp);
+
+            #pragma omp simd
+            for (size_t k = kb; k < kend; ++k)
+            {
+                const auto k3 = out.get_k3(i, j, k);
+                ccomplex_t phitot = vfac[0] * pphi1[k];
+                if (order > 1) phitot += vfac[1] * pphi2[k];
+                if (order > 2) phitot += vfac[2] * pphi3[k];
+
+                const ccomplex_t grad = lg.gradient(idim, k3);
+                ccomplex_t val = grad * phitot;
+                if (order > 2) val += vfac[2] * curl_A3<btransverse>(lg, k3, idimp, idimpp, tb, k - kb, pA3p[k], pA3pp[k]);
+
+                // if multi-species, then add vbc component backwards
+                if (bbaryons)
+                {
+                    const real_t knorm = wnoise.template get_k<real_t>(i, j, k).norm();
+                    val -= theta_bc(knorm) * pwn[k] * grad / (knorm * knorm);
+                }
+
+                // correct with interpolation kernel if we used interpolation to read out the positions (for glasses)
+                if (bglass) val *= compensation(k3);
+
+                // correct velocity with PLT mode growth rate
+                pout[k] = val * (lg.vfac_corr(k3) * fac);
+            }
+        }
+    });
+}
+
+} // namespace lpt_kernels
@@ -0,0 +1,245 @@
+// This file is part of monofonIC (MUSIC2)
+// A software package to generate ICs for cosmological simulations
+// Copyright (C) 2020 by Oliver Hahn
+//
+// monofonIC is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// monofonIC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
+#include <general.hh>
+
+/*!
+ * @brief dependency graph of LPT source terms, each computed by a sequence of convolutions
+ *
+ * Terms whose inputs are available can be computed concurrently: each lane is an OpenMP sub-team
+ * with its own convolver buffers (and FFTW plans made for the sub-team size; lane 0 replans the
+ * caller's convolver for the duration). If only one lane fits into the memory budget, or with MPI
+ * (convolutions are collective operations), the terms are executed one after the other on the
+ * convolver passed by the caller, in insertion order.
+ *
+ * All grids read or written by the tasks must be allocated before execute() is called, since
+ * allocation creates FFTW plans, which is not thread safe.
+ */
+template <typename convolver_t>
+class lpt_task_graph
+{
+public:
+    using task_fn_t = std::function<void(convolver_t &)>;
+
+protected:
+    struct task_t
+    {
+        std::string name;
+        std::vector<size_t> deps; //!< tasks that need to be finished first
+        task_fn_t fn;
+    };
+
+    std::vector<task_t> tasks_;
+
+    //! maximum number of tasks on the same dependency level, an upper bound for useful lanes
+    size_t max_width(void) const
+    {
+        std::vector<size_t> level(tasks_.size(), 0), count(tasks_.size() + 1, 0);
+        for (size_t i = 0; i < tasks_.size(); ++i)
+        {
+            for (auto d : tasks_[i].deps)
+                level[i] = std::max(level[i], level[d] + 1);
+            ++count[level[i]];
+        }
+        return *std::max_element(count.begin(), count.end());
+    }
+
+    void execute_serial(convolver_t &conv)
+    {
+        for (auto &t : tasks_)
+        {
+            double wtime = get_wtime();
+            t.fn(conv);
+            music::dlog.Print("[LPT] term %s took %.3fs", t.name.c_str(), get_wtime() - wtime);
+        }
+    }
+
+#if defined(_OPENMP)
+    void execute_concurrent(convolver_t &conv, const std::array<size_t, 3> &N, const std::array<real_t, 3> &L, int nlanes)
+    {
+        const int nteam = std::max(1, CONFIG::num_threads / nlanes);
+
+        // lane 0 uses the caller's convolver, replanned for the size of one sub-team like the buffers of
+        // the other lanes, so that the lanes together do not run more FFTW threads than there are cores
+#if defined(USE_FFTW_THREADS)
+        if (CONFIG::FFTW_threads_ok)
+        {
+            FFTW_API(plan_with_nthreads)(nteam);
+            conv.replan();
+        }
+#endif
+        std::vector<std::unique_ptr<convolver_t>> extra_lanes;
+        std::vector<convolver_t *> lanes(1, &conv);
+        for (int i = 1; i < nlanes; ++i)
+        {
+            extra_lanes.emplace_back(new convolver_t(N, L));
+            lanes.push_back(extra_lanes.back().get());
+        }
+#if defined(USE_FFTW_THREADS)
+        if (CONFIG::FFTW_threads_ok)
+            FFTW_API(plan_with_nthreads)(CONFIG::num_threads);
+#endif
+
+        const size_t ntasks = tasks_.size();
+        std::vector<int> npending(ntasks, 0);
+        std::vector<std::vector<size_t>> dependents(ntasks);
+        std::vector<bool> started(ntasks, false);
+        for (size_t i = 0; i < ntasks; ++i)
+        {
+            npending[i] = int(tasks_[i].deps.size());
+            for (auto d : tasks_[i].deps)
+                dependents[d].push_back(i);
+        }
+
+        std::atomic<size_t> nfinished{0};
+        std::atomic<bool> babort{false};
+        std::exception_ptr eptr;
+
+        const int old_levels = omp_get_max_active_levels();
+        omp_set_max_active_levels(std::max(old_levels, 2));
+
+        #pragma omp parallel num_threads(nlanes)
+        {
+            // nested parallel regions of this lane use the threads of its sub-team only
+            omp_set_num_threads(nteam);
+            convolver_t &lane_conv = *lanes[omp_get_thread_num()];
+
+            while (nfinished < ntasks && !babort)
+            {
+                long itask = -1;
+                #pragma omp critical(lpt_task_graph)
+                {
+                    for (size_t i = 0; i < ntasks; ++i)
+                    {
+                        if (!started[i] && npending[i] == 0)
+                        {
+                            started[i] = true;
+                            itask = long(i);
+                            break;
+                        }
+                    }
+                }
+
+                if (itask < 0)
+                {
+                    std::this_thread::yield();
+                    continue;
+                }
+
+                double wtime = get_wtime();
+                try
+                {
+                    tasks_[itask].fn(lane_conv);
+                }
+                catch (...)
+                {
+                    #pragma omp critical(lpt_task_graph)
+                    eptr = std::current_exception();
+                    babort = true;
+                }
+                wtime = get_wtime() - wtime;
+
+                #pragma omp critical(lpt_task_graph)
+                {
+                    music::dlog.Print("[LPT] term %s took %.3fs on lane %d", tasks_[itask].name.c_str(), wtime, omp_get_thread_num());
+                    for (auto i : dependents[itask])
+                        --npending[i];
+                }
+                ++nfinished;
+            }
+        }
+
+        omp_set_max_active_levels(old_levels);
+
+        // the caller's convolver gets back its plans for all threads
+#if defined(USE_FFTW_THREADS)
+        if (CONFIG::FFTW_threads_ok)
+            conv.replan();
+#endif
+
+        if (eptr)
+            std::rethrow_exception(eptr);
+    }
+#endif
+
+public:
+    /// @brief add a term to the graph
+    /// @param name name of the term for log output
+    /// @param deps indices of terms that have to be computed first (returned by earlier calls)
+    /// @param fn function computing the term with the convolver it is given
+    /// @return index of the new term
+    size_t add_task(const std::string &name, const std::vector<size_t> &deps, task_fn_t fn)
+    {
+        for (auto d : deps)
+        {
+            if (d >= tasks_.size())
+            {
+                music::elog << "LPT term \'" << name << "\' depends on a term that was not added before it!" << std::endl;
+                throw std::runtime_error("invalid dependency in LPT task graph");
+            }
+        }
+        tasks_.push_back({name, deps, fn});
+        return tasks_.size() - 1;
+    }
+
+    /// @brief compute all terms
+    /// @param conv convolver used for serial execution
+    /// @param N grid size, used to create the convolvers of additional lanes
+    /// @param L box size
+    /// @param max_lanes maximum number of terms computed concurrently
+    /// @param memory_cap maximum memory in bytes for the buffers of the additional lanes (0 = no limit)
+    void execute(convolver_t &conv, const std::array<size_t, 3> &N, const std::array<real_t, 3> &L,
+                 int max_lanes, size_t memory_cap)
+    {
+        int nlanes = std::min<int>({max_lanes, int(this->max_width()), CONFIG::num_threads});
+#if defined(USE_MPI) || !defined(_OPENMP)
+        nlanes = 1;
+#endif
+        // lane 0 runs on conv, only the other lanes need buffers of their own
+        const size_t lane_memory = convolver_t::memory_footprint(N);
+        while (nlanes > 1 && memory_cap > 0 && (nlanes - 1) * lane_memory > memory_cap)
+            --nlanes;
+
+        if (nlanes > 1)
+        {
+            music::ilog << "Computing " << tasks_.size() << " LPT terms on " << nlanes << " concurrent lanes of "
+                        << std::max(1, CONFIG::num_threads / nlanes) << " threads." << std::endl;
+#if defined(_OPENMP)
+            this->execute_concurrent(conv, N, L, nlanes);
+#endif
+        }
+        else
+        {
+            this->execute_serial(conv);
+        }
+    }
+};
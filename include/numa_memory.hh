@@ -0,0 +1,412 @@
+// This file is part of monofonIC (MUSIC2)
+// A software package to generate ICs for cosmological simulations
+// Copyright (C) 2020 by Oliver Hahn
+//
+// monofonIC is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// monofonIC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <list>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <general.hh>
+
+/*!
+ * @brief page placement policy for large grid allocations
+ *
+ * Pages are placed on the NUMA node of the thread that first writes to them. Grids are therefore
+ * touched right after allocation by all threads with a static schedule, which matches the
+ * row distribution of the grid loops (see omp_loops.hh), before FFTW planning or serial reads
+ * can place everything on one node. Optionally pages are interleaved over all nodes, and
+ * transparent or explicit (hugetlbfs) huge pages can be requested.
+ */
+namespace numa_memory
+{
+
+enum placement_t { place_none, place_first_touch, place_interleave };
+enum hugepages_t { huge_none, huge_transparent, huge_explicit };
+
+struct policy_t
+{
+    placement_t placement{place_first_touch};
+    hugepages_t hugepages{huge_none};
+    bool breport{false};
+};
+
+inline policy_t &policy(void)
+{
+    static policy_t p;
+    return p;
+}
+
+//! a block of memory, with the information needed to release it
+struct block_t
+{
+    void *ptr{nullptr};
+    size_t bytes{0};
+    bool bmapped{false}; //!< allocated with mmap (explicit huge pages) instead of fftw_malloc
+};
+
+/// @brief set the policy from the configuration strings
+/// @param placement 'firsttouch', 'interleave' or 'none'
+/// @param hugepages 'none', 'transparent' or 'explicit'
+/// @param breport log the distribution of pages over NUMA nodes for each allocation
+inline void initialise(const std::string &placement, const std::string &hugepages, bool breport)
+{
+    policy_t &p = policy();
+
+    if (placement == "interleave")
+        p.placement = place_interleave;
+    else if (placement == "none")
+        p.placement = place_none;
+    else
+        p.placement = place_first_touch;
+
+    if (hugepages == "transparent")
+        p.hugepages = huge_transparent;
+    else if (hugepages == "explicit")
+        p.hugepages = huge_explicit;
+    else
+        p.hugepages = huge_none;
+
+    p.breport = breport;
+}
+
+//! number of NUMA nodes of the system, parsed from sysfs (1 if unknown)
+inline int num_nodes(void)
+{
+    static int nnodes = -1;
+    if (nnodes < 0)
+    {
+        nnodes = 1;
+        std::ifstream ifs("/sys/devices/system/node/online");
+        std::string line;
+        if (ifs.good() && std::getline(ifs, line))
+        {
+            // format is a list of ranges, e.g. "0-1" or "0,2-3"
+            std::stringstream ss(line);
+            std::string range;
+            int maxnode = 0;
+            while (std::getline(ss, range, ','))
+            {
+                const size_t pos = range.find('-');
+                maxnode = std::max(maxnode, std::stoi(pos == std::string::npos ? range : range.substr(pos + 1)));
+            }
+            nnodes = maxnode + 1;
+        }
+    }
+    return nnodes;
+}
+
+//! size of explicit huge pages from /proc/meminfo (2 MB if unknown)
+inline size_t huge_page_size(void)
+{
+    static size_t hpsz = 0;
+    if (hpsz == 0)
+    {
+        hpsz = size_t(2) << 20;
+        std::ifstream ifs("/proc/meminfo");
+        std::string key;
+        size_t value;
+        while (ifs >> key >> value)
+        {
+            if (key == "Hugepagesize:")
+            {
+                hpsz = value << 10;
+                break;
+            }
+            ifs.ignore(256, '\n');
+        }
+    }
+    return hpsz;
+}
+
+//! write to every page of the block, with the same static distribution over threads as the grid loops
+inline void first_touch(const block_t &b)
+{
+#if defined(__linux__)
+    const size_t pagesz = size_t(sysconf(_SC_PAGESIZE));
+#else
+    const size_t pagesz = 4096;
+#endif
+    char *p = reinterpret_cast<char *>(b.ptr);
+    const size_t npages = (b.bytes + pagesz - 1) / pagesz;
+
+    #pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < npages; ++i)
+    {
+        p[i * pagesz] = 0;
+    }
+}
+
+//! log the fraction of pages on each NUMA node, from a sample of the pages of the block
+inline void report(const block_t &b)
+{
+#if defined(__linux__) && defined(SYS_move_pages)
+    const int nnodes = num_nodes();
+    const size_t pagesz = size_t(sysconf(_SC_PAGESIZE));
+    const uintptr_t first = (reinterpret_cast<uintptr_t>(b.ptr) + pagesz - 1) / pagesz * pagesz;
+    const size_t npages = (reinterpret_cast<uintptr_t>(b.ptr) + b.bytes - first) / pagesz;
+    const size_t nsample = std::min<size_t>(npages, 1024);
+    if (nsample == 0)
+        return;
+
+    std::vector<void *> pages(nsample);
+    std::vector<int> status(nsample, -1);
+    for (size_t i = 0; i < nsample; ++i)
+        pages[i] = reinterpret_cast<void *>(first + (i * npages / nsample) * pagesz);
+
+    // with nodes==NULL, move_pages only queries the node of each page
+    if (syscall(SYS_move_pages, 0, nsample, pages.data(), nullptr, status.data(), 0) != 0)
+        return;
+
+    std::vector<size_t> count(nnodes + 1, 0);
+    for (auto s : status)
+        ++count[(s >= 0 && s < nnodes) ? s : nnodes];
+
+    std::stringstream ss;
+    for (int i = 0; i < nnodes; ++i)
+        ss << " node" << i << ": " << (100.0 * count[i] / nsample) << "%";
+    if (count[nnodes] > 0)
+        ss << " unplaced: " << (100.0 * count[nnodes] / nsample) << "%";
+    music::ilog << "[NUMA] " << (b.bytes >> 20) << " MB block on task " << CONFIG::MPI_task_rank << " :" << ss.str() << std::endl;
+#endif
+}
+
+//! allocate a new block of memory and place its pages according to the policy
+inline block_t allocate_new(size_t bytes)
+{
+    const policy_t &p = policy();
+    block_t b;
+    b.bytes = bytes;
+
+#if defined(__linux__) && defined(MAP_HUGETLB)
+    if (p.hugepages == huge_explicit)
+    {
+        const size_t hpsz = huge_page_size();
+        void *ptr = mmap(nullptr, (bytes + hpsz - 1) / hpsz * hpsz, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (ptr != MAP_FAILED)
+        {
+            b.ptr = ptr;
+            b.bmapped = true;
+        }
+        else
+        {
+            static bool bwarned = false;
+            if (!bwarned)
+                music::wlog << "Could not allocate " << (bytes >> 20) << " MB on explicit huge pages, using normal pages." << std::endl;
+            bwarned = true;
+        }
+    }
+#endif
+
+    if (b.ptr == nullptr)
+    {
+        b.ptr = FFTW_API(malloc)(bytes);
+        if (b.ptr == nullptr)
+        {
+            music::elog << "Failed to allocate " << (bytes >> 20) << " MB!" << std::endl;
+            throw std::bad_alloc();
+        }
+    }
+
+#if defined(__linux__)
+    // advice and memory policies only apply to whole pages inside the block
+    const size_t pagesz = size_t(sysconf(_SC_PAGESIZE));
+    const uintptr_t first = (reinterpret_cast<uintptr_t>(b.ptr) + pagesz - 1) / pagesz * pagesz;
+    const uintptr_t last = (reinterpret_cast<uintptr_t>(b.ptr) + bytes) / pagesz * pagesz;
+
+    if (last > first)
+    {
+#if defined(MADV_HUGEPAGE)
+        if (p.hugepages == huge_transparent)
+            madvise(reinterpret_cast<void *>(first), last - first, MADV_HUGEPAGE);
+#endif
+#if defined(SYS_mbind)
+        const int nnodes = num_nodes();
+        if (p.placement == place_interleave && nnodes > 1)
+        {
+            constexpr int mpol_interleave = 3; // MPOL_INTERLEAVE from numaif.h, avoids linking libnuma
+            std::vector<unsigned long> nodemask((nnodes + 8 * sizeof(unsigned long) - 1) / (8 * sizeof(unsigned long)), 0ul);
+            for (int i = 0; i < nnodes; ++i)
+                nodemask[i / (8 * sizeof(unsigned long))] |= 1ul << (i % (8 * sizeof(unsigned long)));
+            if (syscall(SYS_mbind, first, last - first, mpol_interleave, nodemask.data(), nnodes + 1, 0) != 0)
+                music::dlog << "[NUMA] mbind failed, pages are placed by first touch" << std::endl;
+        }
+#endif
+    }
+#endif
+
+    if (p.placement != place_none)
+        first_touch(b);
+
+    if (p.breport)
+        report(b);
+
+    return b;
+}
+
+//! return the memory of a block to the system
+inline void free_block(block_t &b)
+{
+    if (b.ptr == nullptr)
+        return;
+#if defined(__linux__) && defined(MAP_HUGETLB)
+    if (b.bmapped)
+    {
+        const size_t hpsz = huge_page_size();
+        munmap(b.ptr, (b.bytes + hpsz - 1) / hpsz * hpsz);
+    }
+    else
+#endif
+    {
+        FFTW_API(free)(b.ptr);
+    }
+    b = block_t();
+}
+
+/*!
+ * @brief pool of released blocks, handed out again for requests of the same size
+ *
+ * Grids of the same shape are created and destroyed many times (temporaries of the LPT terms,
+ * convolution buffers, output fields). Keeping a few released blocks avoids mapping, zeroing and
+ * placing multi-GB buffers again; a reused block keeps the page placement of its first allocation.
+ * A request that no idle block matches first frees the least recently released idle blocks until at
+ * least as many bytes as requested are returned, so that the pool never adds to the memory high mark,
+ * while idle blocks of other sizes (e.g. grids next to the communication buffers of the transforms)
+ * survive as long as they are not needed to make room.
+ */
+struct pool_t
+{
+    std::mutex mutex;
+    std::list<block_t> idle; //!< released blocks, most recently released first
+    size_t max_idle{0};      //!< maximum number of idle blocks kept, 0 disables the pool
+    size_t nalloc{0}, nreuse{0}, bytes_alloc{0}, bytes_reuse{0};
+};
+
+inline pool_t &pool(void)
+{
+    static pool_t p;
+    return p;
+}
+
+/// @brief enable or disable reuse of released blocks
+/// @param max_idle maximum number of released blocks kept for reuse (0 = pool disabled)
+inline void pool_initialise(size_t max_idle)
+{
+    pool_t &p = pool();
+    std::lock_guard<std::mutex> lock(p.mutex);
+    p.max_idle = max_idle;
+}
+
+//! get a block of memory, reusing a released block of the same size if there is one, otherwise
+//! idle blocks covering at least the requested size are returned to the system before a new block
+//! is allocated
+inline block_t allocate(size_t bytes)
+{
+    pool_t &p = pool();
+    std::list<block_t> evicted;
+    {
+        std::lock_guard<std::mutex> lock(p.mutex);
+        for (auto it = p.idle.begin(); it != p.idle.end(); ++it)
+        {
+            if (it->bytes == bytes)
+            {
+                block_t b = *it;
+                p.idle.erase(it);
+                ++p.nreuse;
+                p.bytes_reuse += bytes;
+                return b;
+            }
+        }
+        size_t bytes_evicted = 0;
+        while (bytes_evicted < bytes && !p.idle.empty())
+        {
+            bytes_evicted += p.idle.back().bytes;
+            evicted.splice(evicted.end(), p.idle, std::prev(p.idle.end()));
+        }
+        ++p.nalloc;
+        p.bytes_alloc += bytes;
+    }
+    for (auto &b : evicted)
+        free_block(b);
+    return allocate_new(bytes);
+}
+
+//! release a block obtained from allocate(), it is kept for reuse if the pool is enabled
+inline void release(block_t &b)
+{
+    if (b.ptr == nullptr)
+        return;
+
+    pool_t &p = pool();
+    block_t evicted;
+    {
+        std::lock_guard<std::mutex> lock(p.mutex);
+        if (p.max_idle == 0)
+        {
+            evicted = b;
+        }
+        else
+        {
+            p.idle.push_front(b);
+            if (p.idle.size() > p.max_idle)
+            {
+                evicted = p.idle.back();
+                p.idle.pop_back();
+            }
+        }
+    }
+    free_block(evicted);
+    b = block_t();
+}
+
+//! return all idle blocks of the pool to the system
+inline void pool_trim(void)
+{
+    pool_t &p = pool();
+    std::list<block_t> idle;
+    {
+        std::lock_guard<std::mutex> lock(p.mutex);
+        idle.swap(p.idle);
+    }
+    for (auto &b : idle)
+        free_block(b);
+}
+
+//! log how many requests were served from the pool
+inline void pool_report(void)
+{
+    pool_t &p = pool();
+    std::lock_guard<std::mutex> lock(p.mutex);
+    if (p.max_idle == 0 || p.nalloc + p.nreuse == 0)
+        return;
+    music::ilog << "Grid memory pool: " << p.nalloc << " allocations (" << (p.bytes_alloc >> 20) << " MB), "
+                << p.nreuse << " reused (" << (p.bytes_reuse >> 20) << " MB)" << std::endl;
+}
+
+} // namespace numa_memory
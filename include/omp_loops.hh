@@ -0,0 +1,137 @@
+// This file is part of monofonIC (MUSIC2)
+// A software package to generate ICs for cosmological simulations
+// Copyright (C) 2020 by Oliver Hahn
+//
+// monofonIC is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// monofonIC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <omp.h>
+
+#include <general.hh>
+
+/*!
+ * @brief shared loop scheduling for grid kernels
+ *
+ * With MPI, the local slab often has only a few planes, so loops are distributed over the collapsed
+ * (i,j) index space instead of the outer axis alone. The schedule kind and chunk size are set once
+ * at startup (schedule(runtime)), and the per-thread busy time can be collected for an imbalance report.
+ */
+namespace omp_loops
+{
+
+//! accumulated busy time of each thread in parallel_for_2d, only filled if the report is enabled
+inline std::vector<double> &busy_time(void)
+{
+    static std::vector<double> busy;
+    return busy;
+}
+
+//! whether parallel_for_2d records per-thread busy times
+inline bool &report_enabled(void)
+{
+    static bool benabled = false;
+    return benabled;
+}
+
+/// @brief set the runtime schedule used by all grid loops
+/// @param kind 'static', 'dynamic' or 'guided'
+/// @param chunk chunk size in rows of the (i,j) space, 0 for the default
+/// @param breport record per-thread busy times for report_imbalance()
+inline void initialise(const std::string &kind, int chunk, bool breport)
+{
+    omp_sched_t sched = omp_sched_static;
+    if (kind == "dynamic")
+        sched = omp_sched_dynamic;
+    else if (kind == "guided")
+        sched = omp_sched_guided;
+    else if (kind != "static")
+        music::wlog << "Unknown OpenMP schedule \'" << kind << "\', using static." << std::endl;
+
+    omp_set_schedule(sched, std::max(chunk, 0));
+
+    report_enabled() = breport;
+    busy_time().assign(std::max(CONFIG::num_threads, omp_get_max_threads()), 0.0);
+}
+
+/// @brief call f(i,j) for all 0<=i<n0, 0<=j<n1, with the collapsed index space shared by the threads
+template <typename functional>
+inline void parallel_for_2d(size_t n0, size_t n1, const functional &f)
+{
+    if (!report_enabled())
+    {
+        #pragma omp parallel for collapse(2) schedule(runtime)
+        for (size_t i = 0; i < n0; ++i)
+        {
+            for (size_t j = 0; j < n1; ++j)
+            {
+                f(i, j);
+            }
+        }
+        return;
+    }
+
+    std::vector<double> &busy = busy_time();
+
+    #pragma omp parallel
+    {
+        const double t0 = omp_get_wtime();
+
+        #pragma omp for collapse(2) schedule(runtime) nowait
+        for (size_t i = 0; i < n0; ++i)
+        {
+            for (size_t j = 0; j < n1; ++j)
+            {
+                f(i, j);
+            }
+        }
+
+        // threads of concurrent sub-teams share slots, so accumulate atomically
+        const size_t ithread = size_t(omp_get_thread_num());
+        if (ithread < busy.size())
+        {
+            #pragma omp atomic
+            busy[ithread] += omp_get_wtime() - t0;
+        }
+    }
+}
+
+//! print the ratio of maximum to mean busy time of the threads in all parallel_for_2d loops so far
+inline void report_imbalance(void)
+{
+    if (!report_enabled())
+        return;
+
+    const std::vector<double> &busy = busy_time();
+    const size_t nthreads = std::min<size_t>(busy.size(), size_t(CONFIG::num_threads));
+    double tmax = 0.0, tmin = 1e30, tsum = 0.0;
+    for (size_t i = 0; i < nthreads; ++i)
+    {
+        tmax = std::max(tmax, busy[i]);
+        tmin = std::min(tmin, busy[i]);
+        tsum += busy[i];
+    }
+    if (nthreads == 0 || tsum <= 0.0)
+        return;
+
+    const double tmean = tsum / nthreads;
+    music::ilog << "OpenMP grid loops: busy time per thread min/mean/max = " << tmin << "/" << tmean << "/" << tmax
+                << "s, imbalance (max/mean) = " << tmax / tmean << std::endl;
+}
+
+} // namespace omp_loops
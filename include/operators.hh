@@ -58,5 +58,9 @@ public:
     {
         return 1.0;
     }
+
+    //! nothing to tabulate for the standard gradient, interface compatibility with particle::lattice_gradient
+    template< typename grid_t >
+    void precompute( const grid_t& ) {}
 };
 }
@@ -0,0 +1,237 @@
+// This file is part of monofonIC (MUSIC2)
+// A software package to generate ICs for cosmological simulations
+// Copyright (C) 2020 by Oliver Hahn
+//
+// monofonIC is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// monofonIC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <output_plugin.hh>
+
+/*!
+ * @brief output dispatcher that writes the same realisation with several output plug-ins
+ *
+ * The formats and file names are given as comma separated lists in [output] format and filename, all other
+ * [output] options are shared by the sinks. Particles and grids are generated once, in the units and precision
+ * of a reference sink (the first one writing particles, otherwise the first one). Sinks with other units or
+ * precision get a converted copy, made in one pass over all particle properties (or over the grid).
+ */
+class output_multi : public output_plugin
+{
+protected:
+	//! the output plug-ins data is dispatched to
+	std::vector<std::unique_ptr<output_plugin>> sinks_;
+
+	//! index of the sink whose units are used to generate the data
+	size_t iref_;
+
+	//! precision of the generated particle data, the widest any particle sink needs
+	bool b64reals_, b64ids_;
+
+	//! split a comma separated list, removing white space around the entries
+	static std::vector<std::string> split_list( const std::string &str )
+	{
+		std::vector<std::string> list;
+		std::stringstream ss( str );
+		std::string item;
+		while( std::getline( ss, item, ',' ) )
+		{
+			const size_t i0 = item.find_first_not_of(" \t"), i1 = item.find_last_not_of(" \t");
+			list.push_back( (i0 == std::string::npos)? std::string() : item.substr(i0, i1 - i0 + 1) );
+		}
+		return list;
+	}
+
+	//! factor converting a grid component from the reference units to those of sink isink
+	real_t unit_ratio( size_t isink, const fluid_component &c ) const
+	{
+		switch( c )
+		{
+		case fluid_component::dx:
+		case fluid_component::dy:
+		case fluid_component::dz:
+			return sinks_[isink]->position_unit() / sinks_[iref_]->position_unit();
+		case fluid_component::vx:
+		case fluid_component::vy:
+		case fluid_component::vz:
+			return sinks_[isink]->velocity_unit() / sinks_[iref_]->velocity_unit();
+		case fluid_component::mass:
+			return sinks_[isink]->mass_unit() / sinks_[iref_]->mass_unit();
+		default:
+			return 1.0;
+		}
+	}
+
+	//! whether sink isink writes some species as particles
+	bool writes_particles( size_t isink ) const
+	{
+		return sinks_[isink]->writes_species_as( cosmo_species::dm, output_type::particles )
+			|| sinks_[isink]->writes_species_as( cosmo_species::baryon, output_type::particles );
+	}
+
+public:
+	//! constructor, creates the sinks with the format and file name of each in the config
+	output_multi( config_file &cf, std::unique_ptr<cosmology::calculator> &pcc )
+		: output_plugin( cf, pcc, "multi" ), iref_( 0 ), b64reals_( false ), b64ids_( false )
+	{
+		const std::string formats_str = cf_.get_value<std::string>( "output", "format" );
+		const std::vector<std::string> formats = split_list( formats_str ), fnames = split_list( fname_ );
+
+		if( fnames.size() != formats.size() )
+		{
+			music::elog << "Output to " << formats.size() << " formats needs as many file names, got '" << fname_ << "'" << std::endl;
+			throw std::runtime_error("number of output formats and file names differ");
+		}
+
+		for( size_t i = 0; i < formats.size(); ++i )
+		{
+			cf_.insert_value( "output", "format", formats[i] );
+			cf_.insert_value( "output", "filename", fnames[i] );
+			sinks_.push_back( select_output_plugin( cf_, pcc_ ) );
+		}
+		cf_.insert_value( "output", "format", formats_str );
+		cf_.insert_value( "output", "filename", fname_ );
+
+		bool bparticles = false;
+		for( size_t i = 0; i < sinks_.size(); ++i )
+		{
+			if( !writes_particles(i) ) continue;
+			if( !bparticles ) iref_ = i;
+			bparticles = true;
+			b64reals_ |= sinks_[i]->has_64bit_reals();
+			b64ids_   |= sinks_[i]->has_64bit_ids();
+		}
+		if( !bparticles )
+		{
+			b64reals_ = sinks_[iref_]->has_64bit_reals();
+			b64ids_   = sinks_[iref_]->has_64bit_ids();
+		}
+
+		music::ilog << std::setw(32) << std::left << "Output plugins" << " : " << sinks_.size() << ", data generated in the units of '"
+					<< formats[iref_] << "'" << std::endl;
+	}
+
+	output_type write_species_as( const cosmo_species &s ) const { return sinks_[iref_]->write_species_as( s ); }
+
+	bool writes_species_as( const cosmo_species &s, const output_type &t ) const
+	{
+		for( const auto &sink : sinks_ )
+			if( sink->writes_species_as( s, t ) ) return true;
+		return false;
+	}
+
+	bool has_64bit_reals() const { return b64reals_; }
+
+	bool has_64bit_ids() const { return b64ids_; }
+
+	real_t position_unit() const { return sinks_[iref_]->position_unit(); }
+
+	real_t velocity_unit() const { return sinks_[iref_]->velocity_unit(); }
+
+	real_t mass_unit() const { return sinks_[iref_]->mass_unit(); }
+
+	void write_particle_data( const particle::container &pc, const cosmo_species &s, double Omega_species )
+	{
+		const bool bpc64 = !pc.positions64_.empty(), bpc64ids = !pc.ids64_.empty();
+		const size_t np = pc.get_local_num_particles();
+
+		for( size_t isink = 0; isink < sinks_.size(); ++isink )
+		{
+			output_plugin &sink = *sinks_[isink];
+			if( !sink.writes_species_as( s, output_type::particles ) ) continue;
+
+			const double fx = double(sink.position_unit()) / double(position_unit());
+			const double fv = double(sink.velocity_unit()) / double(velocity_unit());
+			const double fm = double(sink.mass_unit()) / double(mass_unit());
+			const bool b64 = sink.has_64bit_reals(), b64ids = sink.has_64bit_ids();
+
+			if( fx == 1.0 && fv == 1.0 && (fm == 1.0 || !pc.bhas_individual_masses_) && b64 == bpc64 && b64ids == bpc64ids )
+			{
+				sink.write_particle_data( pc, s, Omega_species );
+				continue;
+			}
+
+			//... one pass converting positions, velocities, masses and ids to the units and precision of the sink
+			particle::container cpc;
+			cpc.allocate( np, b64, b64ids, pc.bhas_individual_masses_ );
+
+			#pragma omp parallel for
+			for( size_t ip = 0; ip < np; ++ip )
+			{
+				for( size_t idim = 0; idim < 3; ++idim )
+				{
+					const size_t i = 3 * ip + idim;
+					const double x = (bpc64? pc.positions64_[i] : pc.positions32_[i]) * fx;
+					const double v = (bpc64? pc.velocities64_[i] : pc.velocities32_[i]) * fv;
+					if( b64 ){
+						cpc.set_pos64( ip, idim, x );
+						cpc.set_vel64( ip, idim, v );
+					}else{
+						cpc.set_pos32( ip, idim, float(x) );
+						cpc.set_vel32( ip, idim, float(v) );
+					}
+				}
+				if( pc.bhas_individual_masses_ )
+				{
+					const double m = (bpc64? pc.mass64_[ip] : pc.mass32_[ip]) * fm;
+					if( b64 ) cpc.set_mass64( ip, m );
+					else cpc.set_mass32( ip, float(m) );
+				}
+				const uint64_t id = bpc64ids? pc.ids64_[ip] : uint64_t(pc.ids32_[ip]);
+				if( b64ids ) cpc.set_id64( ip, id );
+				else cpc.set_id32( ip, uint32_t(id) );
+			}
+
+			sink.write_particle_data( cpc, s, Omega_species );
+		}
+	}
+
+	void write_grid_data( const Grid_FFT<real_t> &g, const cosmo_species &s, const fluid_component &c )
+	{
+		this->write_grid_data_as( g, s, c, this->write_species_as( s ) );
+	}
+
+	void write_grid_data_as( const Grid_FFT<real_t> &g, const cosmo_species &s, const fluid_component &c, const output_type &t )
+	{
+		for( size_t isink = 0; isink < sinks_.size(); ++isink )
+		{
+			output_plugin &sink = *sinks_[isink];
+			if( !sink.writes_species_as( s, t ) ) continue;
+
+			// only Lagrangian fields carry the units of the output
+			const real_t f = (t == output_type::field_lagrangian)? unit_ratio( isink, c ) : real_t(1.0);
+			if( f == real_t(1.0) )
+			{
+				sink.write_grid_data( g, s, c );
+				continue;
+			}
+
+			//... converted copy, its memory is taken from the grid memory pool
+			Grid_FFT<real_t> gconv( g.n_, g.length_ );
+			if( g.space_ != gconv.space_ )
+				gconv.FourierTransformForward( false );
+
+			#pragma omp parallel for
+			for( size_t i = 0; i < g.ntot_; ++i )
+				gconv.data_[i] = g.data_[i] * f;
+
+			sink.write_grid_data( gconv, s, c );
+		}
+	}
+};
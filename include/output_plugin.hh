@@ -64,6 +64,15 @@ public:
 	//! routine to query whether species is written as grid data
 	virtual output_type write_species_as ( const cosmo_species &s ) const = 0;
 
+	//! routine to query whether species is written in a given form, an output can write a species in several forms
+	virtual bool writes_species_as( const cosmo_species &s, const output_type &t ) const { return write_species_as(s) == t; }
+
+	//! routine to write gridded fluid component data for a species, if it is written in the given form
+	virtual void write_grid_data_as(const Grid_FFT<real_t> &g, const cosmo_species &s, const fluid_component &c, const output_type &t )
+	{
+		if( writes_species_as(s, t) ) write_grid_data(g, s, c);
+	}
+
 	//! routine to query whether species is written as grid data
 	// virtual bool write_species_as_grid( const cosmo_species &s ) = 0;
 
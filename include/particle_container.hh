@@ -148,7 +148,7 @@ public:
 		size_t local_nump = this->get_local_num_particles(), global_nump;
 #ifdef USE_MPI
 		MPI_Allreduce(reinterpret_cast<void *>(&local_nump), reinterpret_cast<void *>(&global_nump), 1,
-					  MPI_UNSIGNED_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+					  MPI_UNSIGNED_LONG_LONG, MPI_SUM, MPI::get_comm());
 #else
 		global_nump = local_nump;
 #endif
@@ -161,13 +161,13 @@ public:
 
 		#ifdef USE_MPI
 			int mpi_size, mpi_rank;
-			MPI_Comm_size( MPI_COMM_WORLD, &mpi_size );
-			MPI_Comm_rank( MPI_COMM_WORLD, &mpi_rank );
+			MPI_Comm_size( MPI::get_comm(), &mpi_size );
+			MPI_Comm_rank( MPI::get_comm(), &mpi_rank );
 			
 			std::vector<size_t> nump_p_task(mpi_size,0), off_p_task;
 			size_t num_p_this_task = this->get_local_num_particles();
 			MPI_Allgather( reinterpret_cast<const void*>(&num_p_this_task), 1, MPI_UNSIGNED_LONG_LONG,
-				reinterpret_cast<void*>(&nump_p_task[0]), 1, MPI_UNSIGNED_LONG_LONG, MPI_COMM_WORLD );
+				reinterpret_cast<void*>(&nump_p_task[0]), 1, MPI_UNSIGNED_LONG_LONG, MPI::get_comm() );
 
 			off_p_task.push_back( 0 );
 			std::partial_sum(nump_p_task.begin(), nump_p_task.end(), std::back_inserter(off_p_task) );
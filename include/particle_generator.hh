@@ -16,6 +16,8 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #pragma once
 
+#include <algorithm>
+
 #include <math/vec3.hh>
 #include <grid_ghosts.hh>
 #include <grid_interpolate.hh>
@@ -70,76 +72,184 @@ namespace particle
         struct glass
         {
             using data_t = typename field_t::data_t;
-            size_t num_p, off_p;
-            grid_interpolate<1, field_t> interp_;
+
+            //! interface to the field interpolator, whose kernel order is a compile time parameter
+            struct interpolator_base
+            {
+                virtual ~interpolator_base() {}
+                virtual void interpolate( const vec3 *pos, size_t np, data_t *val ) = 0;
+                virtual ccomplex_t compensation_kernel_1d( int idim, real_t k ) const = 0;
+            };
+
+            template< int order >
+            struct interpolator : public interpolator_base
+            {
+                grid_interpolate<order, field_t> interp_;
+
+                explicit interpolator( const field_t &field ) : interp_( field ) {}
+
+                void interpolate( const vec3 *pos, size_t np, data_t *val ) { interp_.interpolate( pos, np, val ); }
+
+                ccomplex_t compensation_kernel_1d( int idim, real_t k ) const { return interp_.compensation_kernel_1d( idim, k ); }
+            };
+
+            size_t num_p, num_p_global;
+            std::unique_ptr<interpolator_base> interp_;
             std::vector<vec3> glass_posr;
+            std::vector<size_t> glass_ids;
+
+            //! number of glass particles read from file at once, bounds the read buffer (each task reads the full file)
+            static constexpr size_t read_chunk_ = 1ul << 20;
 
             glass( config_file& cf, const field_t &field )
-            : num_p(0), off_p(0), interp_( field )
+            : num_p(0), num_p_global(0)
             {
-                std::vector<real_t> glass_pos;
                 real_t lglassbox = 1.0;
 
                 std::string glass_fname = cf.get_value<std::string>("setup", "GlassFileName");
                 size_t ntiles = cf.get_value<size_t>("setup", "GlassTiles");
+                std::string interp_str = cf.get_value_safe<std::string>("setup", "GlassInterpolation", "CIC");
+
+                if( interp_str == "CIC" ){
+                    interp_ = std::make_unique<interpolator<1>>( field );
+                }else if( interp_str == "TSC" ){
+                    interp_ = std::make_unique<interpolator<2>>( field );
+                }else if( interp_str == "PCS" ){
+                    interp_ = std::make_unique<interpolator<3>>( field );
+                }else{
+                    music::elog << "Unknown glass interpolation kernel \'" << interp_str << "\', must be CIC, TSC or PCS." << std::endl;
+                    throw std::runtime_error("unknown glass interpolation kernel");
+                }
+                music::ilog << "Glass particles will be interpolated with " << interp_str << " kernel." << std::endl;
+
+                std::array<real_t, 3> ng({real_t(field.n_[0]), real_t(field.n_[1]), real_t(field.n_[2])});
+
+                // extent of the local slab in grid units, only tiled particles falling into it are kept,
+                // so that no redistribution of particles between tasks is needed afterwards
+                const real_t x0 = real_t(field.local_0_start_);
+                const real_t x1 = real_t(field.local_0_start_ + field.local_0_size_);
 
 #if defined(USE_HDF5)
+                std::vector<int> extent;
                 HDFReadGroupAttribute(glass_fname, "Header", "BoxSize", lglassbox);
-                HDFReadDataset(glass_fname, "/PartType1/Coordinates", glass_pos);
+                HDFGetDatasetExtent(glass_fname, "/PartType1/Coordinates", extent);
+                const size_t np_in_file = size_t(extent[0]);
 #else
                 throw std::runtime_error("Class lattice requires HDF5 support. Enable and recompile.");
+                const size_t np_in_file = 0;
 #endif
+                num_p_global = np_in_file * ntiles * ntiles * ntiles;
 
-                size_t np_in_file = glass_pos.size() / 3;
-#if defined(USE_MPI)
-                num_p = np_in_file * ntiles * ntiles * ntiles / MPI::get_size();
-                off_p = MPI::get_rank() * num_p;
-#else
-                num_p = np_in_file * ntiles * ntiles * ntiles;
-                off_p = 0;
+                music::ilog << "Glass file contains " << np_in_file << " particles." << std::endl;
+
+                // periodic wrap into [0,n), the wrapped value can round up to exactly n, which would put
+                // the particle into no task's slab
+                auto wrap = []( real_t x, real_t n ) -> real_t {
+                    const real_t xw = std::fmod( x + n, n );
+                    return (xw >= n)? xw - n : xw;
+                };
+
+                // every task still reads the whole glass file, the chunks only bound the memory needed for it;
+                // each particle is tiled only into the local slab, so no redistribution between tasks is needed
+                std::vector<real_t> glass_pos;
+                for (size_t ichunk = 0; ichunk < np_in_file; ichunk += read_chunk_)
+                {
+                    const size_t nchunk = std::min(read_chunk_, np_in_file - ichunk);
+#if defined(USE_HDF5)
+                    HDFReadVectorSlab(glass_fname, "/PartType1/Coordinates", unsigned(ichunk), unsigned(nchunk), glass_pos);
 #endif
+                    #pragma omp parallel
+                    {
+                        std::vector<vec3> pos_thread;
+                        std::vector<size_t> ids_thread;
 
-                music::ilog << "Glass file contains " << np_in_file << " particles." << std::endl;
+                        #pragma omp for nowait
+                        for (size_t ip = 0; ip < nchunk; ++ip)
+                        {
+                            const size_t idx_in_glass = ichunk + ip;
+                            for (size_t tile_x = 0; tile_x < ntiles; ++tile_x)
+                            {
+                                const real_t px = wrap((glass_pos[3 * ip + 0] / lglassbox + real_t(tile_x)) / ntiles * ng[0], ng[0]);
+                                if (px < x0 || px >= x1) continue;
+
+                                for (size_t tile_y = 0; tile_y < ntiles; ++tile_y)
+                                {
+                                    const real_t py = wrap((glass_pos[3 * ip + 1] / lglassbox + real_t(tile_y)) / ntiles * ng[1], ng[1]);
+                                    for (size_t tile_z = 0; tile_z < ntiles; ++tile_z)
+                                    {
+                                        const real_t pz = wrap((glass_pos[3 * ip + 2] / lglassbox + real_t(tile_z)) / ntiles * ng[2], ng[2]);
+                                        pos_thread.push_back({px, py, pz});
+                                        ids_thread.push_back(((tile_x * ntiles + tile_y) * ntiles + tile_z) * np_in_file + idx_in_glass);
+                                    }
+                                }
+                            }
+                        }
+
+                        #pragma omp critical
+                        {
+                            glass_posr.insert(glass_posr.end(), pos_thread.begin(), pos_thread.end());
+                            glass_ids.insert(glass_ids.end(), ids_thread.begin(), ids_thread.end());
+                        }
+                    }
+                }
+                glass_pos.clear();
+                num_p = glass_posr.size();
 
-                glass_posr.assign(num_p, {0.0, 0.0, 0.0});
+                this->sort_by_cell( field );
 
-                std::array<real_t, 3> ng({real_t(field.n_[0]), real_t(field.n_[1]), real_t(field.n_[2])});
+#if defined(USE_MPI)
+                size_t num_p_sum = 0;
+                MPI_Allreduce( &num_p, &num_p_sum, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, MPI::get_comm() );
+                if( num_p_sum != num_p_global ){
+                    music::elog << "Glass tiling lost particles: " << num_p_sum << " instead of " << num_p_global << std::endl;
+                    abort();
+                }
+#endif
+            }
+
+            //! sort particles by the cell they lie in, so that the interpolation walks the field in memory order
+            //! (ties are broken by particle id, which makes the ordering independent of the thread count)
+            void sort_by_cell( const field_t &field )
+            {
+                std::vector<size_t> cellidx(num_p), perm(num_p);
 
                 #pragma omp parallel for
                 for (size_t i = 0; i < num_p; ++i)
                 {
-                    size_t idxpart = off_p + i;
-                    size_t idx_in_glass = idxpart % np_in_file;
-                    size_t idxtile = idxpart / np_in_file;
-                    size_t tile_z = idxtile % (ntiles * ntiles);
-                    size_t tile_y = ((idxtile - tile_z) / ntiles) % ntiles;
-                    size_t tile_x = (((idxtile - tile_z) / ntiles) - tile_y) / ntiles;
-                    glass_posr[i][0] = std::fmod((glass_pos[3 * idx_in_glass + 0] / lglassbox + real_t(tile_x)) / ntiles * ng[0] + ng[0], ng[0]);
-                    glass_posr[i][1] = std::fmod((glass_pos[3 * idx_in_glass + 1] / lglassbox + real_t(tile_y)) / ntiles * ng[1] + ng[1], ng[1]);
-                    glass_posr[i][2] = std::fmod((glass_pos[3 * idx_in_glass + 2] / lglassbox + real_t(tile_z)) / ntiles * ng[2] + ng[2], ng[2]);
+                    const size_t ix = std::min<size_t>(size_t(glass_posr[i][0]), field.n_[0] - 1);
+                    const size_t iy = std::min<size_t>(size_t(glass_posr[i][1]), field.n_[1] - 1);
+                    const size_t iz = std::min<size_t>(size_t(glass_posr[i][2]), field.n_[2] - 1);
+                    cellidx[i] = (ix * field.n_[1] + iy) * field.n_[2] + iz;
+                    perm[i] = i;
                 }
 
-#if defined(USE_MPI)
-                interp_.domain_decompose_pos(glass_posr);
+                std::sort(perm.begin(), perm.end(), [&](size_t a, size_t b) {
+                    return (cellidx[a] < cellidx[b]) || (cellidx[a] == cellidx[b] && glass_ids[a] < glass_ids[b]);
+                });
 
-                num_p = glass_posr.size();
-                std::vector<size_t> all_num_p( MPI::get_size(), 0 );
-                MPI_Allgather( &num_p, 1, MPI_UNSIGNED_LONG_LONG, &all_num_p[0], 1, MPI_UNSIGNED_LONG_LONG, MPI_COMM_WORLD );
-                off_p = 0;
-                for( int itask=0; itask<=MPI::get_rank(); ++itask ){
-                    off_p += all_num_p[itask];
+                std::vector<vec3> posr_sorted(num_p);
+                std::vector<size_t> ids_sorted(num_p);
+
+                #pragma omp parallel for
+                for (size_t i = 0; i < num_p; ++i)
+                {
+                    posr_sorted[i] = glass_posr[perm[i]];
+                    ids_sorted[i] = glass_ids[perm[i]];
                 }
-#endif
+                glass_posr.swap(posr_sorted);
+                glass_ids.swap(ids_sorted);
             }
 
-            void update_ghosts( const field_t &field )
+            //! interpolate the field at all local particles at once, updates the ghost zones of the field
+            void get_at( std::vector<data_t>& val )
             {
-                interp_.update_ghosts( field );
+                val.resize( num_p );
+                interp_->interpolate( glass_posr.data(), num_p, val.data() );
             }
 
-            data_t get_at( const vec3& x ) const noexcept
+            ccomplex_t compensation_kernel_1d( int idim, real_t k ) const
             {
-                return interp_.get_cic_at( x );
+                return interp_->compensation_kernel_1d( idim, k );
             }
 
             size_t size() const noexcept
@@ -147,9 +257,15 @@ namespace particle
                 return num_p;
             }
 
-            size_t offset() const noexcept
+            size_t global_size() const noexcept
+            {
+                return num_p_global;
+            }
+
+            //! global id of local particle i, given by its tile and index in the glass file
+            size_t id( size_t i ) const noexcept
             {
-                return off_p;
+                return glass_ids[i];
             }
         };
 
@@ -304,7 +420,7 @@ namespace particle
 
                 // set global number of particles
 #if defined(USE_MPI)
-                MPI_Allreduce( &ipcount, &global_num_particles_, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, MPI_COMM_WORLD );
+                MPI_Allreduce( &ipcount, &global_num_particles_, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, MPI::get_comm() );
 #else
                 global_num_particles_ = ipcount;
 #endif
@@ -342,21 +458,20 @@ namespace particle
             }
             else if( lattice_type == lattice_glass )
             {
-                music::wlog << "Glass ICs will currently be incorrect due to disabled ghost zone updates! ";
-
                 glass_ptr_ = std::make_unique<glass>( cf, field );
                 particles_.allocate(glass_ptr_->size(), b64reals, b64ids, false);
+                global_num_particles_ = glass_ptr_->global_size();
 
                 #pragma omp parallel for
                 for (size_t i = 0; i < glass_ptr_->size(); ++i)
                 {
                     if (b64ids)
                     {
-                        particles_.set_id64(i, IDoffset + i + glass_ptr_->offset());
+                        particles_.set_id64(i, IDoffset + glass_ptr_->id(i));
                     }
                     else
                     {
-                        particles_.set_id32(i, IDoffset + i + glass_ptr_->offset());
+                        particles_.set_id32(i, IDoffset + glass_ptr_->id(i));
                     }
                 }
             }
@@ -476,8 +591,8 @@ namespace particle
                 #if defined(USE_MPI)
                 {
                     double local_mean_pm = mean_pm, local_std_pm = std_pm;
-                    MPI_Allreduce( &local_mean_pm, &mean_pm, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD );
-                    MPI_Allreduce( &local_std_pm, &std_pm, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD );
+                    MPI_Allreduce( &local_mean_pm, &mean_pm, 1, MPI_DOUBLE, MPI_SUM, MPI::get_comm() );
+                    MPI_Allreduce( &local_std_pm, &std_pm, 1, MPI_DOUBLE, MPI_SUM, MPI::get_comm() );
                 }
                 #endif
                 mean_pm /= global_num_particles_;
@@ -576,12 +691,14 @@ namespace particle
             }
             else
             {
-                glass_ptr_->update_ghosts( field );
+                std::vector<real_t> dispvals;
+                glass_ptr_->get_at( dispvals );
+
                 #pragma omp parallel for
                 for (size_t i = 0; i < glass_ptr_->size(); ++i)
                 {
                     auto pos = glass_ptr_->glass_posr[i];
-                    real_t disp = glass_ptr_->get_at(pos);
+                    real_t disp = dispvals[i];
                     if (b64reals)
                     {
                         particles_.set_pos64(i, idim, pos[idim] / field.n_[idim] * lunit + disp);
@@ -668,12 +785,13 @@ namespace particle
             }
             else
             {
-                glass_ptr_->update_ghosts( field );
+                std::vector<real_t> velvals;
+                glass_ptr_->get_at( velvals );
+
                 #pragma omp parallel for
                 for (size_t i = 0; i < glass_ptr_->size(); ++i)
                 {
-                    auto pos = glass_ptr_->glass_posr[i];
-                    real_t vel = glass_ptr_->get_at(pos);
+                    real_t vel = velvals[i];
                     if (b64reals)
                     {
                         particles_.set_vel64(i, idim, vel);
@@ -686,6 +804,13 @@ namespace particle
             }
         }
 
+        //! deconvolution kernel for the interpolation used to read out glass particles, along axis idim
+        //! (the kernel is separable, the full kernel is the product over the axes)
+        ccomplex_t compensation_kernel_1d( int idim, real_t k ) const
+        {
+            return glass_ptr_->compensation_kernel_1d( idim, k );
+        }
+
         const particle::container& get_particles() const noexcept{
             return particles_;
         }
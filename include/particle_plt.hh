@@ -22,13 +22,16 @@
 #pragma once
 
 #include <general.hh>
-#include <unistd.h> // for unlink
+#include <unistd.h> // for unlink, close
+#include <cstdlib> // for mkstemp
 
 #include <iostream>
 #include <fstream>
 
 #include <random>
 #include <map>
+#include <string>
+#include <cstdio> // for rename, remove
 
 #include <cassert>
 
@@ -57,6 +60,22 @@ private:
     std::vector<vec3_t<real_t>> vectk_;
     std::vector<vec3_t<int>> ico_, vecitk_;
 
+    //! operators tabulated on the output k-grid: the gradient is purely imaginary, so only
+    //! its imaginary parts are stored, followed by the velocity correction factor
+    std::vector<std::array<real_t,4>> optab_;
+    std::array<size_t,3> tab_n_;
+    size_t tab_i0_;
+    bool tab_transposed_;
+    bool btabulate_; //!< whether precompute() builds the table, otherwise operators are evaluated per mode
+
+    //! convert global mode index into index of operator table
+    inline size_t tab_index( const std::array<size_t,3>& ijk ) const noexcept
+    {
+        const size_t i = tab_transposed_? ijk[1]-tab_i0_ : ijk[0];
+        const size_t j = tab_transposed_? ijk[0] : ijk[1];
+        return (i*tab_n_[1]+j)*tab_n_[2]+ijk[2];
+    }
+
     bool is_even( int i ){ return (i%2)==0; }
 
     bool is_in( int i, int j, int k, const mat3_t<int>& M ){
@@ -336,6 +355,9 @@ private:
             mat3_t<real_t> D;
             vec3_t<real_t> eval, evec1, evec2, evec3_t;
 
+            // thread private FBZ index map, merged after the loop
+            map_t iimap_local;
+
             #pragma omp for
             for( size_t i=0; i<D_xx_.size(0); i++ )
             {
@@ -378,8 +400,7 @@ private:
                                             int iy = std::round(vectk.y*(ngrid_)/twopi);
                                             int iz = std::round(vectk.z*(ngrid_)/twopi);
 
-                                            #pragma omp critical
-                                            {iimap.insert( std::pair<vec3_t<int>,size_t>({ix,iy,iz}, D_xx_.get_idx(i,j,k)) );}
+                                            iimap_local.insert( std::pair<vec3_t<int>,size_t>({ix,iy,iz}, D_xx_.get_idx(i,j,k)) );
 
                                             temp1.kelem(i,j,k) = ccomplex_t(eval[2],eval[1]);
                                             temp2.kelem(i,j,k) = ccomplex_t(eval[0],evec3_t.x);
@@ -392,6 +413,15 @@ private:
                     } //k
                 } //j
             } //i
+
+            // merge, keeping the lowest grid index for each FBZ site as a serial loop would
+            #pragma omp critical
+            {
+                for( const auto& e : iimap_local ){
+                    auto res = iimap.insert( e );
+                    if( !res.second && e.second < res.first->second ) res.first->second = e.second;
+                }
+            }
         }
 
         D_xx_.kelem(0,0,0) = 1.0;
@@ -514,6 +544,111 @@ private:
 #endif   
     }
 
+#if defined(USE_HDF5)
+    //! sums of the four tables, stored last in the cache file so that incomplete files can be detected
+    static std::vector<double> cache_checksum( const std::vector<double>& data_xx, const std::vector<double>& data_xy,
+                                               const std::vector<double>& data_yy, const std::vector<double>& data_zz )
+    {
+        std::vector<double> sum(4, 0.0);
+        for( size_t q=0; q<data_xx.size(); ++q ){
+            sum[0] += data_xx[q]; sum[1] += data_xy[q]; sum[2] += data_yy[q]; sum[3] += data_zz[q];
+        }
+        return sum;
+    }
+
+    //! read the PLT operator tables from an HDF5 cache file, returns false if not present, incomplete or not matching
+    bool read_cache( const std::string& fname )
+    {
+        if( !DoesFileExist( fname ) ) return false;
+
+        const size_t ntot = D_xx_.size(0) * D_xx_.size(1) * D_xx_.size(2);
+        std::vector<double> data_xx, data_xy, data_yy, data_zz, checksum;
+        try{
+            HDFReadDataset( fname, "D_xx", data_xx );
+            HDFReadDataset( fname, "D_xy", data_xy );
+            HDFReadDataset( fname, "D_yy", data_yy );
+            HDFReadDataset( fname, "D_zz", data_zz );
+            HDFReadDataset( fname, "checksum", checksum );
+        }catch( HDFException& e ){
+            music::wlog << "Could not read PLT cache file \'" << fname << "\', recomputing." << std::endl;
+            return false;
+        }
+        if( data_xx.size() != ntot || data_xy.size() != ntot || data_yy.size() != ntot || data_zz.size() != ntot ){
+            music::wlog << "PLT cache file \'" << fname << "\' does not match mesh size, recomputing." << std::endl;
+            return false;
+        }
+        // the sums are accumulated in the same order as on writing, so they have to agree exactly
+        if( checksum != cache_checksum( data_xx, data_xy, data_yy, data_zz ) ){
+            music::wlog << "PLT cache file \'" << fname << "\' is incomplete or corrupt, recomputing." << std::endl;
+            return false;
+        }
+
+        D_xx_.FourierTransformForward(false);
+        D_xy_.FourierTransformForward(false);
+        D_yy_.FourierTransformForward(false);
+        D_zz_.FourierTransformForward(false);
+
+        #pragma omp parallel for
+        for( size_t i=0; i<D_xx_.size(0); i++ ){
+            for( size_t j=0; j<D_xx_.size(1); j++ ){
+                for( size_t k=0; k<D_xx_.size(2); k++ ){
+                    const size_t q = (i*D_xx_.size(1)+j)*D_xx_.size(2)+k;
+                    D_xx_.kelem(i,j,k) = data_xx[q];
+                    D_xy_.kelem(i,j,k) = data_xy[q];
+                    D_yy_.kelem(i,j,k) = data_yy[q];
+                    D_zz_.kelem(i,j,k) = data_zz[q];
+                }
+            }
+        }
+        return true;
+    }
+
+    //! write the PLT operator tables to an HDF5 cache file (written under a unique temporary name, then
+    //! renamed, so concurrent writers never share a file), returns false if the file could not be put in place
+    bool write_cache( const std::string& fname ) const
+    {
+        const size_t ntot = D_xx_.size(0) * D_xx_.size(1) * D_xx_.size(2);
+        std::vector<double> data_xx(ntot), data_xy(ntot), data_yy(ntot), data_zz(ntot);
+
+        #pragma omp parallel for
+        for( size_t i=0; i<D_xx_.size(0); i++ ){
+            for( size_t j=0; j<D_xx_.size(1); j++ ){
+                for( size_t k=0; k<D_xx_.size(2); k++ ){
+                    const size_t q = (i*D_xx_.size(1)+j)*D_xx_.size(2)+k;
+                    data_xx[q] = std::real(D_xx_.kelem(i,j,k));
+                    data_xy[q] = std::real(D_xy_.kelem(i,j,k));
+                    data_yy[q] = std::real(D_yy_.kelem(i,j,k));
+                    data_zz[q] = std::real(D_zz_.kelem(i,j,k));
+                }
+            }
+        }
+
+        std::vector<char> tmpname( fname.begin(), fname.end() );
+        const std::string suffix = ".tmp.XXXXXX";
+        tmpname.insert( tmpname.end(), suffix.begin(), suffix.end() );
+        tmpname.push_back( '\0' );
+        const int fd = mkstemp( tmpname.data() );
+        if( fd < 0 ){
+            music::wlog << "Could not create temporary PLT cache file next to \'" << fname << "\', cache not written" << std::endl;
+            return false;
+        }
+        close( fd );
+
+        const std::string tmpfname( tmpname.data() );
+        HDFCreateFile( tmpfname );
+        HDFWriteDataset( tmpfname, "D_xx", data_xx );
+        HDFWriteDataset( tmpfname, "D_xy", data_xy );
+        HDFWriteDataset( tmpfname, "D_yy", data_yy );
+        HDFWriteDataset( tmpfname, "D_zz", data_zz );
+        HDFWriteDataset( tmpfname, "checksum", cache_checksum( data_xx, data_xy, data_yy, data_zz ) );
+        if( std::rename( tmpfname.c_str(), fname.c_str() ) != 0 ){
+            music::wlog << "Could not rename PLT cache file \'" << tmpfname << "\' to \'" << fname << "\', cache not written" << std::endl;
+            std::remove( tmpfname.c_str() );
+            return false;
+        }
+        return true;
+    }
+#endif
 
 public:
     // real_t boxlen, size_t ngridother
@@ -529,6 +664,8 @@ public:
       grad_x_({ngrid_, ngrid_, ngrid_}, {1.0,1.0,1.0}), grad_y_({ngrid_, ngrid_, ngrid_}, {1.0,1.0,1.0}),
       grad_z_({ngrid_, ngrid_, ngrid_}, {1.0,1.0,1.0})
     { 
+        // the operator table costs as much memory as two extra grids, so it is opt-in
+        btabulate_ = the_config.get_value_safe<bool>("execution", "PLTOperatorTable", false);
         music::ilog << "-------------------------------------------------------------------------------" << std::endl;
         std::string lattice_str = the_config.get_value_safe<std::string>("setup","ParticleLoad","sc");
         const lattice lattice_type = 
@@ -540,15 +677,53 @@ public:
         music::ilog << "PLT corrections for " << lattice_str << " lattice will be computed on " << ngrid_ << "**3 mesh" << std::endl;
 
         double wtime = get_wtime();
-        music::ilog << std::setw(40) << std::setfill('.') << std::left << "Computing PLT eigenmodes "<< std::flush;
-        
-        init_D( lattice_type );
-        // init_D__old();
+        bool bfrom_cache = false;
+
+#if defined(USE_HDF5)
+        // tables only depend on lattice type and mesh size, so they can be reused across runs
+        const std::string cache_dir = the_config.get_value_safe<std::string>("setup","PLTCacheDir","");
+        const std::string cache_fname = cache_dir + "/plt_" + lattice_str + "_" + std::to_string(ngrid_) + ".hdf5";
+        if( !cache_dir.empty() ){
+            music::ilog << std::setw(40) << std::setfill('.') << std::left << "Reading PLT eigenmodes "<< std::flush;
+            bfrom_cache = read_cache( cache_fname );
+            // make sure no task reads while the cache is being written below
+            multitask_sync_barrier();
+            if( bfrom_cache ){
+                music::ilog << std::setw(20) << std::setfill(' ') << std::right << "took " << get_wtime()-wtime << "s" << std::endl;
+            }else{
+                music::ilog << std::setw(20) << std::setfill(' ') << std::right << "not found" << std::endl;
+            }
+        }
+#endif
 
-        music::ilog << std::setw(20) << std::setfill(' ') << std::right << "took " << get_wtime()-wtime << "s" << std::endl;
+        if( !bfrom_cache ){
+            wtime = get_wtime();
+            music::ilog << std::setw(40) << std::setfill('.') << std::left << "Computing PLT eigenmodes "<< std::flush;
+            
+            init_D( lattice_type );
+            // init_D__old();
+
+            music::ilog << std::setw(20) << std::setfill(' ') << std::right << "took " << get_wtime()-wtime << "s" << std::endl;
+
+#if defined(USE_HDF5)
+            // with ensemble groups, every group computes the tables, but only the first task of all writes
+            // them; the file only appears by an atomic rename, so other groups never read a partial cache
+            int world_rank = 0;
+#if defined(USE_MPI)
+            MPI_Comm_rank( MPI_COMM_WORLD, &world_rank );
+#endif
+            if( !cache_dir.empty() && world_rank == 0 ){
+                if( write_cache( cache_fname ) )
+                    music::ilog << "PLT eigenmodes written to cache file \'" << cache_fname << "\'" << std::endl;
+            }
+#endif
+        }
     }
 
-    inline ccomplex_t gradient( const int idim, std::array<size_t,3> ijk ) const
+    /// @brief evaluate all three gradient factors (imaginary parts) and the velocity correction for one mode
+    /// @param ijk global index of the mode on the output grid
+    /// @return array with components {grad_x, grad_y, grad_z, vfac}
+    inline std::array<real_t,4> compute_operators( const std::array<size_t,3>& ijk ) const
     {
         real_t ix = ijk[0]*mapratio_, iy = ijk[1]*mapratio_, iz = ijk[2]*mapratio_;
 
@@ -562,21 +737,13 @@ public:
         
         real_t kr = kv.norm(), kphi = kr>0.0? std::atan2(kv.y,kv.x) : 0.0, ktheta = kr>0.0? std::acos( kv.z / kr ) : 0.0;
         real_t st = std::sin(ktheta), ct = std::cos(ktheta), sp = std::sin(kphi), cp = std::cos(kphi);
-        
-        if( idim == 0 ){
-            return ccomplex_t(0.0, kmod*(D_r * st * cp + D_theta * ct * cp - D_phi * sp)); 
-        }
-        else if( idim == 1 ){
-            return ccomplex_t(0.0, kmod*(D_r  * st * sp + D_theta * ct * sp + D_phi * cp)); 
-        }
-        return ccomplex_t(0.0, kmod*(D_r  * ct - D_theta * st)); 
-    }
 
-    inline real_t vfac_corr( std::array<size_t,3> ijk  ) const
-    {
-        real_t ix = ijk[0]*mapratio_, iy = ijk[1]*mapratio_, iz = ijk[2]*mapratio_;
-        const real_t alpha = 1.0/std::real(D_xy_.get_cic_kspace({ix,iy,iz}));
-        return 1.0/alpha;
+        return {
+            kmod*(D_r * st * cp + D_theta * ct * cp - D_phi * sp),
+            kmod*(D_r * st * sp + D_theta * ct * sp + D_phi * cp),
+            kmod*(D_r * ct - D_theta * st),
+            std::real(D_xy_.get_cic_kspace({ix,iy,iz}))
+        };
         // // below is for LCDM, but it is a tiny correction for typical starting redshifts:
         //! X = \Omega_\Lambda / \Omega_m
         // return 1.0 / (alpha - (2*std::pow(aini_,3)*alpha*(2 + alpha)*XmL_*Hypergeometric2F1((3 + alpha)/3.,(5 + alpha)/3.,
@@ -584,6 +751,61 @@ public:
         //     ((7 + 4*alpha)*Hypergeometric2F1(alpha/3.,(2 + alpha)/3.,(7 + 4*alpha)/6.,-(std::pow(aini_,3)*XmL_))));
     }
 
+    /// @brief tabulate the operators on the local part of the output k-grid, so that gradient() and 
+    ///        vfac_corr() become table lookups for all subsequent passes
+    /// @param g output grid, only its k-space layout is used (the grid can be in either space)
+    template< typename grid_t >
+    void precompute( const grid_t& g )
+    {
+        //... k-space layout: transposed slabs of local_1_size x n0 x (n2/2+1) with MPI, n0 x n1 x (n2/2+1) without
+        tab_transposed_ = g.is_distributed();
+        tab_n_ = tab_transposed_? std::array<size_t,3>{ size_t(g.local_1_size_), g.n_[0], g.n_[2]/2+1 }
+                                : std::array<size_t,3>{ g.n_[0], g.n_[1], g.n_[2]/2+1 };
+        tab_i0_ = tab_transposed_? size_t(g.local_1_start_) : 0;
+
+        // 4 reals per mode, i.e. as much as two complex grids
+        const double table_mb = double(tab_n_[0]*tab_n_[1]*tab_n_[2]) * sizeof(optab_[0]) / 1024.0 / 1024.0;
+        if( !btabulate_ ){
+            music::ilog << "PLT operators are evaluated per mode (table of " << table_mb << " MBytes per task disabled, enable with PLTOperatorTable = yes)" << std::endl;
+            return;
+        }
+        music::ilog << "PLT operator table needs " << table_mb << " MBytes per task (about two grids)" << std::endl;
+
+        double wtime = get_wtime();
+        music::ilog << std::setw(40) << std::setfill('.') << std::left << "Tabulating PLT operators "<< std::flush;
+
+        optab_.assign( tab_n_[0]*tab_n_[1]*tab_n_[2], {0.0,0.0,0.0,0.0} );
+
+        #pragma omp parallel for
+        for( size_t i=0; i<tab_n_[0]; ++i ){
+            for( size_t j=0; j<tab_n_[1]; ++j ){
+                for( size_t k=0; k<tab_n_[2]; ++k ){
+                    const std::array<size_t,3> ijk = tab_transposed_? std::array<size_t,3>{ j, i+tab_i0_, k } 
+                                                                    : std::array<size_t,3>{ i, j, k };
+                    optab_[(i*tab_n_[1]+j)*tab_n_[2]+k] = this->compute_operators( ijk );
+                }
+            }
+        }
+
+        music::ilog << std::setw(20) << std::setfill(' ') << std::right << "took " << get_wtime()-wtime << "s" << std::endl;
+    }
+
+    inline ccomplex_t gradient( const int idim, std::array<size_t,3> ijk ) const
+    {
+        if( !optab_.empty() ){
+            return ccomplex_t(0.0, optab_[this->tab_index(ijk)][idim]);
+        }
+        return ccomplex_t(0.0, this->compute_operators(ijk)[idim]);
+    }
+
+    inline real_t vfac_corr( std::array<size_t,3> ijk  ) const
+    {
+        if( !optab_.empty() ){
+            return optab_[this->tab_index(ijk)][3];
+        }
+        return this->compute_operators(ijk)[3];
+    }
+
 };
 
 }
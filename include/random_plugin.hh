@@ -34,6 +34,8 @@ class RNG_plugin
     }
     virtual ~RNG_plugin() {}
     virtual bool isMultiscale() const = 0;
+    //! whether Fill_Grid can be called again and gives the same field, cheap enough to regenerate it on demand
+    virtual bool isRepeatable() const { return false; }
     virtual void Fill_Grid( Grid_FFT<real_t>& g ) = 0;//const = 0;
     //virtual void FillGrid(int level, DensityGrid<real_t> &R) = 0;
 };
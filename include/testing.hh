@@ -23,8 +23,11 @@
 #include <cosmology_calculator.hh>
 
 namespace testing{
+    //! all tests insert suffix into their output file names, so that the outputs of several realisations
+    //! (pairs, ensemble members, groups) do not overwrite each other
+
     void output_potentials_and_densities( 
-        config_file& the_config,
+        config_file& the_config, const std::string& suffix,
         size_t ngrid, real_t boxlen,
         Grid_FFT<real_t>& phi,
         Grid_FFT<real_t>& phi2,
@@ -32,7 +35,7 @@ namespace testing{
         std::array< Grid_FFT<real_t>*,3 >& A3 );
 
     void output_velocity_displacement_symmetries(
-        config_file &the_config,
+        config_file &the_config, const std::string &suffix,
         size_t ngrid, real_t boxlen, real_t vfac, real_t dplus,
         Grid_FFT<real_t> &phi,
         Grid_FFT<real_t> &phi2,
@@ -41,7 +44,7 @@ namespace testing{
         bool bwrite_out_fields=false);
 
     void output_convergence(
-        config_file &the_config,
+        config_file &the_config, const std::string &suffix,
         cosmology::calculator* the_cosmo_calc,
         std::size_t ngrid, real_t boxlen, real_t vfac, real_t dplus,
         Grid_FFT<real_t> &phi,
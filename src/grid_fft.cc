@@ -18,6 +18,9 @@
 #include <general.hh>
 #include <grid_fft.hh>
 #include <thread>
+#include <map>
+#include <algorithm>
+#include <limits>
 
 #include "memory_stat.hh"
 
@@ -27,7 +30,7 @@ void memory_report(void)
     size_t curr_mem_high_mark = 0;
     local_mem_high_mark = memory::getCurrentRSS();
 #if defined(USE_MPI)
-    MPI_Allreduce(&local_mem_high_mark, &curr_mem_high_mark, 1, MPI_UNSIGNED_LONG_LONG, MPI_MAX, MPI_COMM_WORLD);
+    MPI_Allreduce(&local_mem_high_mark, &curr_mem_high_mark, 1, MPI_UNSIGNED_LONG_LONG, MPI_MAX, MPI::get_comm());
 #else
     curr_mem_high_mark = local_mem_high_mark;
 #endif
@@ -40,6 +43,10 @@ void memory_report(void)
 template <typename data_t, bool bdistributed>
 void Grid_FFT<data_t, bdistributed>::allocate(void)
 {
+    // a grid that is already allocated keeps its memory and plans
+    if (ballocated_)
+        return;
+
     if (!bdistributed)
     {
         ntot_ = (n_[2] + 2) * n_[1] * n_[0];
@@ -47,7 +54,8 @@ void Grid_FFT<data_t, bdistributed>::allocate(void)
         music::dlog.Print("[FFT] Setting up a shared memory field %lux%lux%lu\n", n_[0], n_[1], n_[2]);
         if (typeid(data_t) == typeid(real_t))
         {
-            data_ = reinterpret_cast<data_t *>(FFTW_API(malloc)(ntot_ * sizeof(real_t)));
+            mem_ = numa_memory::allocate(ntot_ * sizeof(real_t));
+            data_ = reinterpret_cast<data_t *>(mem_.ptr);
             cdata_ = reinterpret_cast<ccomplex_t *>(data_);
 
             plan_ = FFTW_API(plan_dft_r2c_3d)(n_[0], n_[1], n_[2], (real_t *)data_, (complex_t *)data_, FFTW_RUNMODE);
@@ -55,7 +63,8 @@ void Grid_FFT<data_t, bdistributed>::allocate(void)
         }
         else if (typeid(data_t) == typeid(ccomplex_t))
         {
-            data_ = reinterpret_cast<data_t *>(FFTW_API(malloc)(ntot_ * sizeof(ccomplex_t)));
+            mem_ = numa_memory::allocate(ntot_ * sizeof(ccomplex_t));
+            data_ = reinterpret_cast<data_t *>(mem_.ptr);
             cdata_ = reinterpret_cast<ccomplex_t *>(data_);
 
             plan_ = FFTW_API(plan_dft_3d)(n_[0], n_[1], n_[2], (complex_t *)data_, (complex_t *)data_, FFTW_FORWARD, FFTW_RUNMODE);
@@ -117,27 +126,40 @@ void Grid_FFT<data_t, bdistributed>::allocate(void)
 
         if (typeid(data_t) == typeid(real_t))
         {
-            cmplxsz = FFTW_API(mpi_local_size_3d_transposed)(n_[0], n_[1], n_[2], MPI_COMM_WORLD,
+            cmplxsz = FFTW_API(mpi_local_size_3d_transposed)(n_[0], n_[1], n_[2], MPI::get_comm(),
                                                              &local_0_size_, &local_0_start_, &local_1_size_, &local_1_start_);
             ntot_ = local_0_size_ * n_[1] * (n_[2]+2);
-            data_ = (data_t *)FFTW_API(malloc)(ntot_ * sizeof(real_t));
+            if (CONFIG::FFT_overlap_batches > 0)
+            {
+                // the in-house transform needs room for the transposed layout as well
+                ntot_ = std::max<size_t>(ntot_, 2 * local_1_size_ * n_[0] * (n_[2]/2+1));
+            }
+            mem_ = numa_memory::allocate(ntot_ * sizeof(real_t));
+            data_ = reinterpret_cast<data_t *>(mem_.ptr);
             cdata_ = reinterpret_cast<ccomplex_t *>(data_);
-            plan_ = FFTW_API(mpi_plan_dft_r2c_3d)(n_[0], n_[1], n_[2], (real_t *)data_, (complex_t *)data_,
-                                                  MPI_COMM_WORLD, FFTW_RUNMODE | FFTW_MPI_TRANSPOSED_OUT);
-            iplan_ = FFTW_API(mpi_plan_dft_c2r_3d)(n_[0], n_[1], n_[2], (complex_t *)data_, (real_t *)data_,
-                                                   MPI_COMM_WORLD, FFTW_RUNMODE | FFTW_MPI_TRANSPOSED_IN);
+            if (CONFIG::FFT_overlap_batches == 0)
+            {
+                plan_ = FFTW_API(mpi_plan_dft_r2c_3d)(n_[0], n_[1], n_[2], (real_t *)data_, (complex_t *)data_,
+                                                      MPI::get_comm(), FFTW_RUNMODE | FFTW_MPI_TRANSPOSED_OUT);
+                iplan_ = FFTW_API(mpi_plan_dft_c2r_3d)(n_[0], n_[1], n_[2], (complex_t *)data_, (real_t *)data_,
+                                                       MPI::get_comm(), FFTW_RUNMODE | FFTW_MPI_TRANSPOSED_IN);
+            }
         }
         else if (typeid(data_t) == typeid(ccomplex_t))
         {
-            cmplxsz = FFTW_API(mpi_local_size_3d_transposed)(n_[0], n_[1], n_[2], MPI_COMM_WORLD,
+            cmplxsz = FFTW_API(mpi_local_size_3d_transposed)(n_[0], n_[1], n_[2], MPI::get_comm(),
                                                              &local_0_size_, &local_0_start_, &local_1_size_, &local_1_start_);
             ntot_ = cmplxsz;
-            data_ = (data_t *)FFTW_API(malloc)(ntot_ * sizeof(ccomplex_t));
+            mem_ = numa_memory::allocate(ntot_ * sizeof(ccomplex_t));
+            data_ = reinterpret_cast<data_t *>(mem_.ptr);
             cdata_ = reinterpret_cast<ccomplex_t *>(data_);
-            plan_ = FFTW_API(mpi_plan_dft_3d)(n_[0], n_[1], n_[2], (complex_t *)data_, (complex_t *)data_,
-                                              MPI_COMM_WORLD, FFTW_FORWARD, FFTW_RUNMODE | FFTW_MPI_TRANSPOSED_OUT);
-            iplan_ = FFTW_API(mpi_plan_dft_3d)(n_[0], n_[1], n_[2], (complex_t *)data_, (complex_t *)data_,
-                                               MPI_COMM_WORLD, FFTW_BACKWARD, FFTW_RUNMODE | FFTW_MPI_TRANSPOSED_IN);
+            if (CONFIG::FFT_overlap_batches == 0)
+            {
+                plan_ = FFTW_API(mpi_plan_dft_3d)(n_[0], n_[1], n_[2], (complex_t *)data_, (complex_t *)data_,
+                                                  MPI::get_comm(), FFTW_FORWARD, FFTW_RUNMODE | FFTW_MPI_TRANSPOSED_OUT);
+                iplan_ = FFTW_API(mpi_plan_dft_3d)(n_[0], n_[1], n_[2], (complex_t *)data_, (complex_t *)data_,
+                                                   MPI::get_comm(), FFTW_BACKWARD, FFTW_RUNMODE | FFTW_MPI_TRANSPOSED_IN);
+            }
         }
         else
         {
@@ -187,11 +209,17 @@ void Grid_FFT<data_t, bdistributed>::allocate(void)
             sizes_[2] = npc_;
             sizes_[3] = npc_; // holds the physical memory size along the 3rd dimension
         }
+
+        if (CONFIG::FFT_overlap_batches > 0)
+        {
+            this->setup_slab_fft();
+        }
 #else
         music::flog << "MPI is required for distributed FFT arrays!" << std::endl;
         throw std::runtime_error("MPI is required for distributed FFT arrays!");
 #endif //// of #ifdef #else USE_MPI ////////////////////////////////////////////////////////////////////////////////////
     }
+    this->setup_k_tables();
     ballocated_ = true;
     memory_report();
 }
@@ -208,10 +236,6 @@ void Grid_FFT<data_t, bdistributed>::ApplyNorm(void)
 template <typename data_t, bool bdistributed>
 void Grid_FFT<data_t, bdistributed>::FourierTransformForward(bool do_transform)
 {
-#if defined(USE_MPI)
-    MPI_Barrier(MPI_COMM_WORLD);
-#endif
-
     if (space_ != kspace_id)
     {
         //.............................
@@ -219,8 +243,14 @@ void Grid_FFT<data_t, bdistributed>::FourierTransformForward(bool do_transform)
         {
             double wtime = get_wtime();
             music::dlog.Print("[FFT] Calling Grid_FFT::to_kspace (%lux%lux%lu)", sizes_[0], sizes_[1], sizes_[2]);
-            FFTW_API(execute)
-            (plan_);
+            if (slab_fft_ != nullptr)
+            {
+                this->slab_fft_forward();
+            }
+            else
+            {
+                FFTW_API(execute)(plan_);
+            }
             this->ApplyNorm();
 
             wtime = get_wtime() - wtime;
@@ -241,10 +271,6 @@ void Grid_FFT<data_t, bdistributed>::FourierTransformForward(bool do_transform)
 template <typename data_t, bool bdistributed>
 void Grid_FFT<data_t, bdistributed>::FourierTransformBackward(bool do_transform)
 {
-#if defined(USE_MPI)
-    MPI_Barrier(MPI_COMM_WORLD);
-#endif
-
     if (space_ != rspace_id)
     {
         //.............................
@@ -253,7 +279,14 @@ void Grid_FFT<data_t, bdistributed>::FourierTransformBackward(bool do_transform)
             music::dlog.Print("[FFT] Calling Grid_FFT::to_rspace (%dx%dx%d)\n", sizes_[0], sizes_[1], sizes_[2]);
             double wtime = get_wtime();
 
-            FFTW_API(execute)(iplan_);
+            if (slab_fft_ != nullptr)
+            {
+                this->slab_fft_backward();
+            }
+            else
+            {
+                FFTW_API(execute)(iplan_);
+            }
             this->ApplyNorm();
 
             wtime = get_wtime() - wtime;
@@ -269,6 +302,436 @@ void Grid_FFT<data_t, bdistributed>::FourierTransformBackward(bool do_transform)
     }
 }
 
+#if defined(USE_MPI)
+//! convert a count or displacement for MPI to int, aborting if it does not fit
+inline int mpi_count(size_t n)
+{
+    if (n > size_t(std::numeric_limits<int>::max()))
+    {
+        music::elog << "MPI count " << n << " exceeds the int range, use more MPI tasks" << std::endl;
+        abort();
+    }
+    return int(n);
+}
+
+//! contiguous MPI datatype of n complex values, counts in units of it stay small at large grid sizes
+inline MPI_Datatype make_complex_row_type(size_t n)
+{
+    MPI_Datatype row;
+    MPI_Type_contiguous(mpi_count(n), MPI::get_datatype<ccomplex_t>(), &row);
+    MPI_Type_commit(&row);
+    return row;
+}
+#endif
+
+/// @brief in-house slab decomposed 3D FFT, producing the same transposed layout as FFTW-MPI
+///
+/// The forward transform does 2D transforms of the local x-planes, a global transpose, and 1D transforms
+/// along x; the backward transform runs the same steps in reverse. The work is split into batches of planes,
+/// and the nonblocking all-to-all of each batch runs while the next batch is transformed.
+template <typename data_t, bool bdistributed>
+struct Grid_FFT<data_t, bdistributed>::slab_fft
+{
+#if defined(USE_MPI)
+    int nbatches;
+    std::vector<ptrdiff_t> x0, nx, y0, ny; //!< real space slabs and k-space slabs of all tasks
+    MPI_Datatype pencil;                   //!< one row of npc_ complex values, unit of all counts
+    fftw_plan_t plan2d, iplan2d;           //!< in place 2D transforms of one x-plane
+    fftw_plan_t plan1d, iplan1d;           //!< in place 1D transforms along x of one ky-plane
+
+    //! first plane of batch ib when n planes are split into nbatches
+    ptrdiff_t batch_start(ptrdiff_t n, int ib) const noexcept { return (n * ib) / nbatches; }
+#endif
+};
+
+template <typename data_t, bool bdistributed>
+void Grid_FFT<data_t, bdistributed>::setup_slab_fft(void)
+{
+#if defined(USE_MPI)
+    slab_fft_ = new slab_fft;
+    slab_fft &sf = *slab_fft_;
+    const int ntasks = MPI::get_size();
+
+    sf.nbatches = CONFIG::FFT_overlap_batches;
+    sf.x0.assign(ntasks, 0);
+    sf.nx.assign(ntasks, 0);
+    sf.y0.assign(ntasks, 0);
+    sf.ny.assign(ntasks, 0);
+
+    MPI_Allgather(&local_0_start_, 1, MPI_LONG_LONG, &sf.x0[0], 1, MPI_LONG_LONG, MPI::get_comm());
+    MPI_Allgather(&local_0_size_, 1, MPI_LONG_LONG, &sf.nx[0], 1, MPI_LONG_LONG, MPI::get_comm());
+    MPI_Allgather(&local_1_start_, 1, MPI_LONG_LONG, &sf.y0[0], 1, MPI_LONG_LONG, MPI::get_comm());
+    MPI_Allgather(&local_1_size_, 1, MPI_LONG_LONG, &sf.ny[0], 1, MPI_LONG_LONG, MPI::get_comm());
+
+    sf.pencil = make_complex_row_type(npc_);
+
+    // single planes are transformed concurrently by OpenMP threads, so plan them single-threaded
+#if defined(USE_FFTW_THREADS)
+    if (CONFIG::FFTW_threads_ok)
+        FFTW_API(plan_with_nthreads)(1);
+#endif
+
+    const int n2d[2] = {int(n_[1]), int(n_[2])};
+    const int n1d[1] = {int(n_[0])};
+    sf.plan2d = sf.iplan2d = sf.plan1d = sf.iplan1d = nullptr;
+
+    if (local_0_size_ > 0)
+    {
+        if (typeid(data_t) == typeid(real_t))
+        {
+            const int rembed[2] = {int(n_[1]), int(npr_)}, cembed[2] = {int(n_[1]), int(npc_)};
+            sf.plan2d = FFTW_API(plan_many_dft_r2c)(2, n2d, 1, (real_t *)data_, rembed, 1, 0, (complex_t *)data_, cembed, 1, 0,
+                                                    FFTW_RUNMODE | FFTW_UNALIGNED);
+            sf.iplan2d = FFTW_API(plan_many_dft_c2r)(2, n2d, 1, (complex_t *)data_, cembed, 1, 0, (real_t *)data_, rembed, 1, 0,
+                                                     FFTW_RUNMODE | FFTW_UNALIGNED);
+        }
+        else
+        {
+            sf.plan2d = FFTW_API(plan_many_dft)(2, n2d, 1, (complex_t *)data_, nullptr, 1, 0, (complex_t *)data_, nullptr, 1, 0,
+                                                FFTW_FORWARD, FFTW_RUNMODE | FFTW_UNALIGNED);
+            sf.iplan2d = FFTW_API(plan_many_dft)(2, n2d, 1, (complex_t *)data_, nullptr, 1, 0, (complex_t *)data_, nullptr, 1, 0,
+                                                 FFTW_BACKWARD, FFTW_RUNMODE | FFTW_UNALIGNED);
+        }
+    }
+
+    if (local_1_size_ > 0)
+    {
+        sf.plan1d = FFTW_API(plan_many_dft)(1, n1d, int(npc_), (complex_t *)data_, nullptr, int(npc_), 1, (complex_t *)data_, nullptr, int(npc_), 1,
+                                            FFTW_FORWARD, FFTW_RUNMODE | FFTW_UNALIGNED);
+        sf.iplan1d = FFTW_API(plan_many_dft)(1, n1d, int(npc_), (complex_t *)data_, nullptr, int(npc_), 1, (complex_t *)data_, nullptr, int(npc_), 1,
+                                             FFTW_BACKWARD, FFTW_RUNMODE | FFTW_UNALIGNED);
+    }
+
+#if defined(USE_FFTW_THREADS)
+    if (CONFIG::FFTW_threads_ok)
+        FFTW_API(plan_with_nthreads)(CONFIG::num_threads);
+#endif
+
+    music::dlog.Print("[FFT] Using in-house distributed transform with %d overlapped batches", sf.nbatches);
+#endif
+}
+
+template <typename data_t, bool bdistributed>
+void Grid_FFT<data_t, bdistributed>::free_slab_fft(void)
+{
+#if defined(USE_MPI)
+    for (auto p : {slab_fft_->plan2d, slab_fft_->iplan2d, slab_fft_->plan1d, slab_fft_->iplan1d})
+    {
+        if (p != nullptr)
+            FFTW_API(destroy_plan)(p);
+    }
+    int finalized = 0;
+    MPI_Finalized(&finalized);
+    if (!finalized)
+        MPI_Type_free(&slab_fft_->pencil);
+#endif
+    delete slab_fft_;
+    slab_fft_ = nullptr;
+}
+
+template <typename data_t, bool bdistributed>
+void Grid_FFT<data_t, bdistributed>::slab_fft_forward(void)
+{
+#if defined(USE_MPI)
+    const slab_fft &sf = *slab_fft_;
+    const int ntasks = MPI::get_size();
+    const size_t n0 = n_[0], n1 = n_[1], npc = npc_;
+    const ptrdiff_t nxloc = local_0_size_, nyloc = local_1_size_;
+    const bool breal = (typeid(data_t) == typeid(real_t));
+
+    // send buffer holds pencils ordered by batch, then by destination; receive buffer holds them as [x][ky];
+    // both are taken from the memory pool, so repeated transforms of the same shape reuse them
+    numa_memory::block_t sendblk = numa_memory::allocate(std::max<size_t>(1, nxloc * n1 * npc) * sizeof(ccomplex_t));
+    ccomplex_t *sendbuf = reinterpret_cast<ccomplex_t *>(sendblk.ptr);
+    numa_memory::block_t recvblk = numa_memory::allocate(std::max<size_t>(1, n0 * nyloc * npc) * sizeof(ccomplex_t));
+    ccomplex_t *recvbuf = reinterpret_cast<ccomplex_t *>(recvblk.ptr);
+
+    // counts and displacements (in pencils) must stay valid until the nonblocking all-to-all completes
+    std::vector<int> comm(4 * ntasks * sf.nbatches, 0);
+    std::vector<MPI_Request> req(sf.nbatches, MPI_REQUEST_NULL);
+
+    for (int ib = 0; ib < sf.nbatches; ++ib)
+    {
+        const ptrdiff_t xb0 = sf.batch_start(nxloc, ib), nxb = sf.batch_start(nxloc, ib + 1) - xb0;
+
+        #pragma omp parallel for
+        for (ptrdiff_t x = xb0; x < xb0 + nxb; ++x)
+        {
+            ccomplex_t *plane = cdata_ + x * n1 * npc;
+            if (breal)
+                FFTW_API(execute_dft_r2c)(sf.plan2d, reinterpret_cast<real_t *>(plane), reinterpret_cast<complex_t *>(plane));
+            else
+                FFTW_API(execute_dft)(sf.plan2d, reinterpret_cast<complex_t *>(plane), reinterpret_cast<complex_t *>(plane));
+
+            for (int t = 0; t < ntasks; ++t)
+            {
+                std::copy_n(plane + sf.y0[t] * npc, sf.ny[t] * npc,
+                            sendbuf + (xb0 * n1 + nxb * sf.y0[t] + (x - xb0) * sf.ny[t]) * npc);
+            }
+        }
+
+        int *sendcounts = &comm[4 * ntasks * ib], *senddispls = sendcounts + ntasks;
+        int *recvcounts = senddispls + ntasks, *recvdispls = recvcounts + ntasks;
+        for (int t = 0; t < ntasks; ++t)
+        {
+            const ptrdiff_t xs0 = sf.batch_start(sf.nx[t], ib), xs1 = sf.batch_start(sf.nx[t], ib + 1);
+            sendcounts[t] = mpi_count(nxb * sf.ny[t]);
+            senddispls[t] = mpi_count(xb0 * n1 + nxb * sf.y0[t]);
+            recvcounts[t] = mpi_count((xs1 - xs0) * nyloc);
+            recvdispls[t] = mpi_count((sf.x0[t] + xs0) * nyloc);
+        }
+
+        MPI_Ialltoallv(sendbuf, sendcounts, senddispls, sf.pencil, recvbuf, recvcounts, recvdispls, sf.pencil, MPI::get_comm(), &req[ib]);
+
+        // give the MPI library a chance to progress the exchanges in flight
+        int flag = 0;
+        MPI_Testall(ib + 1, &req[0], &flag, MPI_STATUSES_IGNORE);
+    }
+
+    MPI_Waitall(sf.nbatches, &req[0], MPI_STATUSES_IGNORE);
+
+    #pragma omp parallel for
+    for (ptrdiff_t y = 0; y < nyloc; ++y)
+    {
+        ccomplex_t *plane = cdata_ + y * n0 * npc;
+        for (size_t x = 0; x < n0; ++x)
+        {
+            std::copy_n(recvbuf + (x * nyloc + y) * npc, npc, plane + x * npc);
+        }
+        FFTW_API(execute_dft)(sf.plan1d, reinterpret_cast<complex_t *>(plane), reinterpret_cast<complex_t *>(plane));
+    }
+
+    numa_memory::release(sendblk);
+    numa_memory::release(recvblk);
+#endif
+}
+
+template <typename data_t, bool bdistributed>
+void Grid_FFT<data_t, bdistributed>::slab_fft_backward(void)
+{
+#if defined(USE_MPI)
+    const slab_fft &sf = *slab_fft_;
+    const int ntasks = MPI::get_size();
+    const size_t n0 = n_[0], n1 = n_[1], npc = npc_;
+    const ptrdiff_t nxloc = local_0_size_, nyloc = local_1_size_;
+    const bool breal = (typeid(data_t) == typeid(real_t));
+
+    // send buffer holds pencils ordered by batch, then as [x][ky]; receive buffer by source and batch
+    numa_memory::block_t sendblk = numa_memory::allocate(std::max<size_t>(1, n0 * nyloc * npc) * sizeof(ccomplex_t));
+    ccomplex_t *sendbuf = reinterpret_cast<ccomplex_t *>(sendblk.ptr);
+    numa_memory::block_t recvblk = numa_memory::allocate(std::max<size_t>(1, nxloc * n1 * npc) * sizeof(ccomplex_t));
+    ccomplex_t *recvbuf = reinterpret_cast<ccomplex_t *>(recvblk.ptr);
+
+    std::vector<int> comm(4 * ntasks * sf.nbatches, 0);
+    std::vector<MPI_Request> req(sf.nbatches, MPI_REQUEST_NULL);
+
+    for (int ib = 0; ib < sf.nbatches; ++ib)
+    {
+        const ptrdiff_t yb0 = sf.batch_start(nyloc, ib), nyb = sf.batch_start(nyloc, ib + 1) - yb0;
+
+        #pragma omp parallel for
+        for (ptrdiff_t y = yb0; y < yb0 + nyb; ++y)
+        {
+            ccomplex_t *plane = cdata_ + y * n0 * npc;
+            FFTW_API(execute_dft)(sf.iplan1d, reinterpret_cast<complex_t *>(plane), reinterpret_cast<complex_t *>(plane));
+
+            for (size_t x = 0; x < n0; ++x)
+            {
+                std::copy_n(plane + x * npc, npc, sendbuf + (yb0 * n0 + x * nyb + (y - yb0)) * npc);
+            }
+        }
+
+        int *sendcounts = &comm[4 * ntasks * ib], *senddispls = sendcounts + ntasks;
+        int *recvcounts = senddispls + ntasks, *recvdispls = recvcounts + ntasks;
+        for (int t = 0; t < ntasks; ++t)
+        {
+            const ptrdiff_t ys0 = sf.batch_start(sf.ny[t], ib), ys1 = sf.batch_start(sf.ny[t], ib + 1);
+            sendcounts[t] = mpi_count(sf.nx[t] * nyb);
+            senddispls[t] = mpi_count(yb0 * n0 + sf.x0[t] * nyb);
+            recvcounts[t] = mpi_count(nxloc * (ys1 - ys0));
+            recvdispls[t] = mpi_count(nxloc * (sf.y0[t] + ys0));
+        }
+
+        MPI_Ialltoallv(sendbuf, sendcounts, senddispls, sf.pencil, recvbuf, recvcounts, recvdispls, sf.pencil, MPI::get_comm(), &req[ib]);
+
+        int flag = 0;
+        MPI_Testall(ib + 1, &req[0], &flag, MPI_STATUSES_IGNORE);
+    }
+
+    // all k-space data has been packed, so batches can be unpacked in place as they arrive
+    for (int ib = 0; ib < sf.nbatches; ++ib)
+    {
+        MPI_Wait(&req[ib], MPI_STATUS_IGNORE);
+
+        for (int s = 0; s < ntasks; ++s)
+        {
+            const ptrdiff_t ys0 = sf.batch_start(sf.ny[s], ib), nys = sf.batch_start(sf.ny[s], ib + 1) - ys0;
+            const ccomplex_t *src = recvbuf + nxloc * (sf.y0[s] + ys0) * npc;
+
+            #pragma omp parallel for
+            for (ptrdiff_t x = 0; x < nxloc; ++x)
+            {
+                std::copy_n(src + x * nys * npc, nys * npc, cdata_ + (x * n1 + sf.y0[s] + ys0) * npc);
+            }
+        }
+    }
+
+    #pragma omp parallel for
+    for (ptrdiff_t x = 0; x < nxloc; ++x)
+    {
+        ccomplex_t *plane = cdata_ + x * n1 * npc;
+        if (breal)
+            FFTW_API(execute_dft_c2r)(sf.iplan2d, reinterpret_cast<complex_t *>(plane), reinterpret_cast<real_t *>(plane));
+        else
+            FFTW_API(execute_dft)(sf.iplan2d, reinterpret_cast<complex_t *>(plane), reinterpret_cast<complex_t *>(plane));
+    }
+
+    numa_memory::release(sendblk);
+    numa_memory::release(recvblk);
+#endif
+}
+
+#if defined(USE_MPI)
+//! communication plan of FourierInterpolateCopyTo for one pair of grid shapes, all counts are in slices
+struct fourier_copy_plan
+{
+    std::vector<int> sendcounts, senddispls, recvcounts, recvdispls;
+    std::vector<size_t> send_slices, recv_slices; //!< local slice indices in buffer order
+    std::vector<size_t> rows_to, rows_from;       //!< rows (2nd index) in the target grid and matching rows in the source grid
+    size_t nk;                                    //!< number of modes along the 3rd dimension present in both grids
+    MPI_Datatype slice_type;                      //!< one packed slice
+};
+
+//! build the plan to copy the modes common to both (transposed, k-space) grids, needs to be called by all tasks
+template <typename grid_t>
+fourier_copy_plan make_fourier_copy_plan( const grid_t &grid_from, const grid_t &grid_to )
+{
+    fourier_copy_plan plan;
+
+    //... determine communication offsets
+    std::vector<ptrdiff_t> offsets_send, offsets_recv, sizes_send, sizes_recv;
+
+    auto get_task = [](ptrdiff_t index, const std::vector<ptrdiff_t> &offsets, const int ntasks) -> int
+    {
+        return int(std::upper_bound(offsets.begin(), offsets.begin() + ntasks, index) - offsets.begin()) - 1;
+    };
+
+    const int ntasks(MPI::get_size());
+
+    offsets_send.assign(ntasks+1, 0);
+    sizes_send.assign(ntasks, 0);
+    offsets_recv.assign(ntasks+1, 0);
+    sizes_recv.assign(ntasks, 0);
+
+    MPI_Allgather(&grid_from.local_1_size_, 1, MPI_LONG_LONG, &sizes_send[0], 1,
+                    MPI_LONG_LONG, MPI::get_comm());
+    MPI_Allgather(&grid_to.local_1_size_, 1, MPI_LONG_LONG, &sizes_recv[0], 1,
+                    MPI_LONG_LONG, MPI::get_comm());
+    MPI_Allgather(&grid_from.local_1_start_, 1, MPI_LONG_LONG, &offsets_send[0], 1,
+                    MPI_LONG_LONG, MPI::get_comm());
+    MPI_Allgather(&grid_to.local_1_start_, 1, MPI_LONG_LONG, &offsets_recv[0], 1,
+                    MPI_LONG_LONG, MPI::get_comm());
+
+    for( int i=0; i< ntasks; i++ ){
+        if( offsets_send[i+1] < offsets_send[i] + sizes_send[i] ) offsets_send[i+1] = offsets_send[i] + sizes_send[i];
+        if( offsets_recv[i+1] < offsets_recv[i] + sizes_recv[i] ) offsets_recv[i+1] = offsets_recv[i] + sizes_recv[i];
+    }
+
+    // determine effective Nyquist modes representable by both fields and their locations in array
+    const size_t fny0_left  = std::min(grid_from.n_[1] / 2, grid_to.n_[1] / 2);
+    const size_t fny0_right = std::max(grid_from.n_[1] - grid_to.n_[1] / 2, grid_from.n_[1] / 2);
+    const size_t fny1_left  = std::min(grid_from.n_[0] / 2, grid_to.n_[0] / 2);
+    const size_t fny1_right = std::max(grid_from.n_[0] - grid_to.n_[0] / 2, grid_from.n_[0] / 2);
+    const size_t fny2_left  = std::min(grid_from.n_[2] / 2, grid_to.n_[2] / 2);
+
+    const size_t fny0_left_recv  = fny0_left;
+    const size_t fny0_right_recv = (fny0_right + grid_to.n_[1]) - grid_from.n_[1];
+    const size_t fny1_left_recv  = fny1_left;
+    const size_t fny1_right_recv = (fny1_right + grid_to.n_[0]) - grid_from.n_[0];
+
+    //... rows of a slice that are present in both grids, the same for every slice
+    for( size_t j=0; j<grid_to.n_[0]; ++j )
+    {
+        if( j < fny1_left_recv || j > fny1_right_recv )
+        {
+            plan.rows_to.push_back( j );
+            plan.rows_from.push_back( (j < fny1_left_recv)? j : (j + grid_from.n_[0]) - grid_to.n_[0] );
+        }
+    }
+    plan.nk = fny2_left;
+
+    //... slices to send, sorted by destination task, then by global index in the target grid
+    std::vector<std::array<size_t,3>> sends, recvs;
+    for (size_t i = 0; i < size_t(grid_from.local_1_size_); ++i)
+    {
+        const size_t iglobal_send = i + grid_from.local_1_start_;
+        if (iglobal_send < fny0_left || iglobal_send > fny0_right)
+        {
+            const size_t iglobal_recv = (iglobal_send < fny0_left)? iglobal_send : (iglobal_send + grid_to.n_[1]) - grid_from.n_[1];
+            sends.push_back({{size_t(get_task(iglobal_recv, offsets_recv, ntasks)), iglobal_recv, i}});
+        }
+    }
+
+    //... slices to receive, sorted by source task, then by global index in the target grid
+    for (size_t i = 0; i < size_t(grid_to.local_1_size_); ++i)
+    {
+        const size_t iglobal_recv = i + grid_to.local_1_start_;
+        if (iglobal_recv < fny0_left_recv || iglobal_recv > fny0_right_recv)
+        {
+            const size_t iglobal_send = (iglobal_recv < fny0_left_recv)? iglobal_recv : (iglobal_recv + grid_from.n_[1]) - grid_to.n_[1];
+            recvs.push_back({{size_t(get_task(iglobal_send, offsets_send, ntasks)), iglobal_recv, i}});
+        }
+    }
+
+    std::sort(sends.begin(), sends.end());
+    std::sort(recvs.begin(), recvs.end());
+
+    plan.sendcounts.assign(ntasks, 0);
+    plan.senddispls.assign(ntasks, 0);
+    plan.recvcounts.assign(ntasks, 0);
+    plan.recvdispls.assign(ntasks, 0);
+
+    for (const auto &s : sends)
+    {
+        ++plan.sendcounts[s[0]];
+        plan.send_slices.push_back(s[2]);
+    }
+    for (const auto &r : recvs)
+    {
+        ++plan.recvcounts[r[0]];
+        plan.recv_slices.push_back(r[2]);
+    }
+    for (int itask = 1; itask < ntasks; ++itask)
+    {
+        plan.senddispls[itask] = plan.senddispls[itask - 1] + plan.sendcounts[itask - 1];
+        plan.recvdispls[itask] = plan.recvdispls[itask - 1] + plan.recvcounts[itask - 1];
+    }
+
+    // counting in slices keeps the counts well within int range at large N
+    plan.slice_type = make_complex_row_type(plan.rows_to.size() * plan.nk);
+
+    music::dlog << "[MPI] Created communication plan for Fourier interpolation/copy" << std::endl;
+
+    return plan;
+}
+
+//! plans of FourierInterpolateCopyTo, reused for all copies between grids of the same pair of shapes
+std::map<std::array<size_t, 6>, fourier_copy_plan> &fourier_copy_plans(void)
+{
+    static std::map<std::array<size_t, 6>, fourier_copy_plan> plans;
+    return plans;
+}
+#endif
+
+void free_fourier_copy_plans(void)
+{
+#if defined(USE_MPI)
+    for (auto &p : fourier_copy_plans())
+        MPI_Type_free(&p.second.slice_type);
+    fourier_copy_plans().clear();
+#endif
+}
+
 //! Perform a copy to another field, not necessarily the same size, using Fourier interpolation
 template <typename data_t, bool bdistributed>
 void Grid_FFT<data_t, bdistributed>::FourierInterpolateCopyTo( grid_fft_t &grid_to )
@@ -337,154 +800,57 @@ void Grid_FFT<data_t, bdistributed>::FourierInterpolateCopyTo( grid_fft_t &grid_
     double tstart = get_wtime();
     music::dlog << "[MPI] Started scatter for Fourier interpolation/copy" << std::endl;
 
-    //... determine communication offsets
-    std::vector<ptrdiff_t> offsets_send, offsets_recv, sizes_send, sizes_recv;
+    // plans are reused for all copies between grids of the same pair of shapes
+    auto &plans = fourier_copy_plans();
+    const std::array<size_t, 6> shapes{{grid_from.n_[0], grid_from.n_[1], grid_from.n_[2], grid_to.n_[0], grid_to.n_[1], grid_to.n_[2]}};
 
-    // this should use bisection, not linear search
-    auto get_task = [](ptrdiff_t index, const std::vector<ptrdiff_t> &offsets, const int ntasks) -> int
+    auto itplan = plans.find(shapes);
+    if (itplan == plans.end())
     {
-        int itask = 0;
-        while (itask < ntasks - 1 && offsets[itask + 1] <= index)
-            ++itask;
-        return itask;
-    };
-
-    int ntasks(MPI::get_size());
-
-    offsets_send.assign(ntasks+1, 0);
-    sizes_send.assign(ntasks, 0);
-    offsets_recv.assign(ntasks+1, 0);
-    sizes_recv.assign(ntasks, 0);
-
-    MPI_Allgather(&grid_from.local_1_size_, 1, MPI_LONG_LONG, &sizes_send[0], 1,
-                    MPI_LONG_LONG, MPI_COMM_WORLD);
-    MPI_Allgather(&grid_to.local_1_size_, 1, MPI_LONG_LONG, &sizes_recv[0], 1,
-                    MPI_LONG_LONG, MPI_COMM_WORLD);
-    MPI_Allgather(&grid_from.local_1_start_, 1, MPI_LONG_LONG, &offsets_send[0], 1,
-                    MPI_LONG_LONG, MPI_COMM_WORLD);
-    MPI_Allgather(&grid_to.local_1_start_, 1, MPI_LONG_LONG, &offsets_recv[0], 1,
-                    MPI_LONG_LONG, MPI_COMM_WORLD);
-
-    for( int i=0; i< CONFIG::MPI_task_size; i++ ){
-        if( offsets_send[i+1] < offsets_send[i] + sizes_send[i] ) offsets_send[i+1] = offsets_send[i] + sizes_send[i];
-        if( offsets_recv[i+1] < offsets_recv[i] + sizes_recv[i] ) offsets_recv[i+1] = offsets_recv[i] + sizes_recv[i];
+        itplan = plans.emplace(shapes, make_fourier_copy_plan(grid_from, grid_to)).first;
     }
+    const fourier_copy_plan &plan = itplan->second;
 
-    const MPI_Datatype datatype =
-        (typeid(data_t) == typeid(float)) ? MPI_C_FLOAT_COMPLEX 
-        : (typeid(data_t) == typeid(double)) ? MPI_C_DOUBLE_COMPLEX 
-        : (typeid(data_t) == typeid(long double)) ? MPI_C_LONG_DOUBLE_COMPLEX
-        : MPI_BYTE;
+    const size_t nrows = plan.rows_to.size(), nk = plan.nk, slicesz = nrows * nk;
 
-    const size_t slicesz = grid_from.size(1) * grid_from.size(3);
-
-    // determine effective Nyquist modes representable by both fields and their locations in array
-    const size_t fny0_left  = std::min(grid_from.n_[1] / 2, grid_to.n_[1] / 2);
-    const size_t fny0_right = std::max(grid_from.n_[1] - grid_to.n_[1] / 2, grid_from.n_[1] / 2);
-    const size_t fny1_left  = std::min(grid_from.n_[0] / 2, grid_to.n_[0] / 2);
-    const size_t fny1_right = std::max(grid_from.n_[0] - grid_to.n_[0] / 2, grid_from.n_[0] / 2);
-    const size_t fny2_left  = std::min(grid_from.n_[2] / 2, grid_to.n_[2] / 2);
-    // size_t fny2_right = std::max(grid_from.n_[2] - grid_to.n_[2] / 2, grid_from.n_[2] / 2);
+    //--- pack the modes present in both grids into one contiguous buffer, ordered by destination
+    numa_memory::block_t sendblk = numa_memory::allocate(std::max<size_t>(1, plan.send_slices.size() * slicesz) * sizeof(ccomplex_t));
+    numa_memory::block_t recvblk = numa_memory::allocate(std::max<size_t>(1, plan.recv_slices.size() * slicesz) * sizeof(ccomplex_t));
+    ccomplex_t *sendbuf = reinterpret_cast<ccomplex_t *>(sendblk.ptr);
+    ccomplex_t *recvbuf = reinterpret_cast<ccomplex_t *>(recvblk.ptr);
 
-    const size_t fny0_left_recv  = fny0_left;
-    const size_t fny0_right_recv = (fny0_right + grid_to.n_[1]) - grid_from.n_[1];
-    const size_t fny1_left_recv  = fny1_left;
-    const size_t fny1_right_recv = (fny1_right + grid_to.n_[0]) - grid_from.n_[0];
-    const size_t fny2_left_recv  = fny2_left;
-    // const size_t fny2_right_recv = (fny2_right + grid_to.n_[2]) - grid_from.n_[2];
-
-    //--- send data from buffer ---------------------------------------------------
-    
-    std::vector<MPI_Request> req;
-    MPI_Request temp_req;
-
-    for (size_t i = 0; i < grid_from.size(0); ++i)
+    #pragma omp parallel for
+    for (size_t islice = 0; islice < plan.send_slices.size(); ++islice)
     {
-        size_t iglobal_send = i + offsets_send[CONFIG::MPI_task_rank];
-        
-        if (iglobal_send < fny0_left) 
-        {
-            size_t iglobal_recv = iglobal_send;
-            int sendto = get_task(iglobal_recv, offsets_recv, CONFIG::MPI_task_size);
-            MPI_Isend(&grid_from.kelem(i * slicesz), (int)slicesz, datatype, sendto,
-                        (int)iglobal_recv, MPI_COMM_WORLD, &temp_req);
-            req.push_back(temp_req);
-            // std::cout << "task " << CONFIG::MPI_task_rank << " : added request No" << req.size()-1 << ": Isend #" << iglobal_send << " to task " << sendto << ", size = " << slicesz << std::endl;
-        }
-        if (iglobal_send > fny0_right) 
+        const size_t i = plan.send_slices[islice];
+        for (size_t r = 0; r < nrows; ++r)
         {
-            size_t iglobal_recv = (iglobal_send + grid_to.n_[1]) - grid_from.n_[1]; 
-            int sendto = get_task(iglobal_recv, offsets_recv, CONFIG::MPI_task_size);
-            MPI_Isend(&grid_from.kelem(i * slicesz), (int)slicesz, datatype, sendto,
-                        (int)iglobal_recv, MPI_COMM_WORLD, &temp_req);
-            req.push_back(temp_req);
-            // std::cout << "task  " << CONFIG::MPI_task_rank << " : added request No" << req.size()-1 << ": Isend #" << iglobal_send << " to task " << sendto << ", size = " << slicesz<< std::endl;
+            for (size_t k = 0; k < nk; ++k)
+            {
+                sendbuf[(islice * nrows + r) * nk + k] = grid_from.kelem(i, plan.rows_from[r], k);
+            }
         }
     }
 
-    //--- receive data ------------------------------------------------------------
-    #pragma omp parallel if(CONFIG::MPI_threads_ok)
-    {
-        MPI_Status status;
-        ccomplex_t  * recvbuf = new ccomplex_t[ slicesz ]; 
-
-        #pragma omp for schedule(dynamic) 
-        for( size_t i=0; i<grid_to.size(0); ++i )
-        {   
-            size_t iglobal_recv = i + offsets_recv[CONFIG::MPI_task_rank];
+    MPI_Alltoallv(sendbuf, plan.sendcounts.data(), plan.senddispls.data(), plan.slice_type,
+                  recvbuf, plan.recvcounts.data(), plan.recvdispls.data(), plan.slice_type, MPI::get_comm());
 
-            if (iglobal_recv < fny0_left_recv || iglobal_recv > fny0_right_recv)
+    //--- unpack into target grid
+    #pragma omp parallel for
+    for (size_t islice = 0; islice < plan.recv_slices.size(); ++islice)
+    {
+        const size_t i = plan.recv_slices[islice];
+        for (size_t r = 0; r < nrows; ++r)
+        {
+            for (size_t k = 0; k < nk; ++k)
             {
-                size_t iglobal_send = (iglobal_recv < fny0_left_recv)? iglobal_recv : (iglobal_recv + grid_from.n_[1]) - grid_to.n_[1];
-
-                int recvfrom = get_task(iglobal_send, offsets_send, CONFIG::MPI_task_size);
-                
-                //#pragma omp critical // need critical region here if we do "MPI_THREAD_FUNNELED", 
-                {
-                    // receive data slice and check for MPI errors when in debug mode
-                    status.MPI_ERROR = MPI_SUCCESS;
-                    MPI_Recv(&recvbuf[0], (int)slicesz, datatype, recvfrom, (int)iglobal_recv, MPI_COMM_WORLD, &status);
-                    assert(status.MPI_ERROR == MPI_SUCCESS);
-                }
-
-                // copy data slice into new grid, avoiding modes that do not exist in both
-                for( size_t j=0; j<grid_to.size(1); ++j )
-                {
-                    if( j < fny1_left_recv || j > fny1_right_recv )
-                    {
-                        const size_t jsend = (j < fny1_left_recv)? j : (j + grid_from.n_[0]) - grid_to.n_[0];
-
-                        for( size_t k=0; k<fny2_left_recv; ++k )
-                        {
-                            grid_to.kelem(i,j,k) = recvbuf[jsend * grid_from.sizes_[3] + k];
-                        }
-                    }
-                }
+                grid_to.kelem(i, plan.rows_to[r], k) = recvbuf[(islice * nrows + r) * nk + k];
             }
         }
-        delete[] recvbuf;
-    }
-    MPI_Barrier( MPI_COMM_WORLD );
-    
-    MPI_Status status;
-    for (size_t i = 0; i < req.size(); ++i)
-    {
-        // need to set status as wait does not necessarily modify it
-        // c.f. http://www.open-mpi.org/community/lists/devel/2007/04/1402.php
-        status.MPI_ERROR = MPI_SUCCESS;
-        // std::cout << "task " << CONFIG::MPI_task_rank << " : checking request No" << i << std::endl;
-        int flag(1);
-        MPI_Test(&req[i], &flag, &status);
-        if( !flag ){
-            std::cout << "task " << CONFIG::MPI_task_rank << " : request No" << i << " unsuccessful" << std::endl;
-        }
-
-        MPI_Wait(&req[i], &status);
-        // std::cout << "---> ok!" << std::endl;
-        assert(status.MPI_ERROR == MPI_SUCCESS);
     }
 
-    MPI_Barrier(MPI_COMM_WORLD);
+    numa_memory::release(sendblk);
+    numa_memory::release(recvblk);
 
     music::dlog.Print("[MPI] Completed scatter for Fourier interpolation/copy, took %fs\n",
                         get_wtime() - tstart);  
@@ -635,7 +1001,7 @@ void Grid_FFT<data_t, bdistributed>::Read_from_HDF5(const std::string Filename,
 
     //... copy data to internal array ...
     real_t sum1{0.0}, sum2{0.0};
-    #pragma omp parallel for reduction(+ : sum1, sum2)
+    #pragma omp parallel for collapse(2) schedule(runtime) reduction(+ : sum1, sum2)
     for (size_t i = 0; i < size(0); ++i)
     {
         for (size_t j = 0; j < size(1); ++j)
@@ -653,7 +1019,7 @@ void Grid_FFT<data_t, bdistributed>::Read_from_HDF5(const std::string Filename,
     auto stdw = std::sqrt(sum2 - sum1 * sum1);
     music::ilog << "Constraint field has <W>=" << sum1 << ", <W^2>-<W>^2=" << stdw << std::endl;
 
-    #pragma omp parallel for reduction(+ : sum1, sum2)
+    #pragma omp parallel for collapse(2) schedule(runtime) reduction(+ : sum1, sum2)
     for (size_t i = 0; i < size(0); ++i)
     {
         for (size_t j = 0; j < size(1); ++j)
@@ -812,11 +1178,11 @@ void Grid_FFT<data_t, bdistributed>::Write_to_HDF5(std::string fname, std::strin
 
     if (!file_exists(fname) && mpi_rank == 0)
         create_hdf5(fname);
-    MPI_Barrier(MPI_COMM_WORLD);
+    MPI_Barrier(MPI::get_comm());
 
 #if defined(USE_MPI_IO)
     plist_id = H5Pcreate(H5P_FILE_ACCESS);
-    H5Pset_fapl_mpio(plist_id, MPI_COMM_WORLD, MPI_INFO_NULL);
+    H5Pset_fapl_mpio(plist_id, MPI::get_comm(), MPI_INFO_NULL);
 #else
     plist_id = H5P_DEFAULT;
 #endif
@@ -835,10 +1201,10 @@ void Grid_FFT<data_t, bdistributed>::Write_to_HDF5(std::string fname, std::strin
     std::vector<size_t> offsets0(MPI::get_size()+1, 0);
 
     MPI_Allgather((this->space_==kspace_id)? &this->local_1_start_ : &this->local_0_start_, 1, 
-        MPI_UNSIGNED_LONG_LONG, &offsets0[0], 1, MPI_UNSIGNED_LONG_LONG, MPI_COMM_WORLD);
+        MPI_UNSIGNED_LONG_LONG, &offsets0[0], 1, MPI_UNSIGNED_LONG_LONG, MPI::get_comm());
 
     MPI_Allgather((this->space_==kspace_id)? &this->local_1_size_ : &this->local_0_size_, 1, 
-        MPI_UNSIGNED_LONG_LONG, &sizes0[0], 1, MPI_UNSIGNED_LONG_LONG, MPI_COMM_WORLD);
+        MPI_UNSIGNED_LONG_LONG, &sizes0[0], 1, MPI_UNSIGNED_LONG_LONG, MPI::get_comm());
 
     for( int i=0; i< CONFIG::MPI_task_size; i++ ){
         if( offsets0[i+1] < offsets0[i] + sizes0[i] ) offsets0[i+1] = offsets0[i] + sizes0[i];
@@ -848,14 +1214,14 @@ void Grid_FFT<data_t, bdistributed>::Write_to_HDF5(std::string fname, std::strin
 
 #if defined(USE_MPI)
         auto loc_count = size(0), glob_count = size(0);
-        MPI_Allreduce( &loc_count, &glob_count, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, MPI_COMM_WORLD );
+        MPI_Allreduce( &loc_count, &glob_count, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, MPI::get_comm() );
 #endif
 
 #if defined(USE_MPI) && !defined(USE_MPI_IO)
 
     for (int itask = 0; itask < mpi_size; ++itask)
     {
-        MPI_Barrier(MPI_COMM_WORLD);
+        MPI_Barrier(MPI::get_comm());
         if (itask != mpi_rank)
             continue;
 
@@ -1181,16 +1547,16 @@ void Grid_FFT<data_t, bdistributed>::Compute_PowerSpectrum(std::vector<double> &
     std::vector<size_t> tempvi(nbins, 0);
 
     MPI_Allreduce(reinterpret_cast<void *>(&bin_k[0]), reinterpret_cast<void *>(&tempv[0]),
-                  nbins, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+                  nbins, MPI_DOUBLE, MPI_SUM, MPI::get_comm());
     bin_k.swap(tempv);
     MPI_Allreduce(reinterpret_cast<void *>(&bin_P[0]), reinterpret_cast<void *>(&tempv[0]),
-                  nbins, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+                  nbins, MPI_DOUBLE, MPI_SUM, MPI::get_comm());
     bin_P.swap(tempv);
     MPI_Allreduce(reinterpret_cast<void *>(&bin_eP[0]), reinterpret_cast<void *>(&tempv[0]),
-                  nbins, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+                  nbins, MPI_DOUBLE, MPI_SUM, MPI::get_comm());
     bin_eP.swap(tempv);
     MPI_Allreduce(reinterpret_cast<void *>(&bin_count[0]), reinterpret_cast<void *>(&tempvi[0]),
-                  nbins, MPI_UNSIGNED_LONG, MPI_SUM, MPI_COMM_WORLD);
+                  nbins, MPI_UNSIGNED_LONG, MPI_SUM, MPI::get_comm());
     bin_count.swap(tempvi);
 
 #endif
@@ -19,6 +19,8 @@
 #include <grid_fft.hh>
 #include <operators.hh>
 #include <convolution.hh>
+#include <lpt_task_graph.hh>
+#include <lpt_kernels.hh>
 #include <testing.hh>
 
 #include <ic_generator.hh>
@@ -55,6 +57,291 @@ std::unique_ptr<output_plugin> the_output_plugin;
 //! global cosmology object (calculates all things cosmological)
 std::unique_ptr<cosmology::calculator>  the_cosmo_calc;
 
+//! write both members of a paired simulation from one LPT computation
+bool bGeneratePair{false};
+
+//! starting redshifts, ICs for all of them are written from the same LPT potentials
+std::vector<double> zstart_list;
+
+//! seeds of an ensemble of realisations generated with the same setup, empty for a single realisation
+std::vector<long> ensemble_seeds;
+
+//! whether an ensemble was requested (this group of tasks may still have no seeds of it)
+bool bEnsemble{false};
+
+//! index of the realisation currently generated
+size_t iensemble{0};
+
+//! output file name from the config file, each output of a pair or redshift list gets a suffixed copy of it
+std::string output_filename;
+
+//! one cosmology of a sweep, given by its [cosmology] key/value pairs that differ from the config file
+struct sweep_cosmology_t
+{
+    size_t id; //!< index in the sweep file, used in the output file name
+    std::vector<std::pair<std::string, std::string>> params;
+};
+
+//! cosmologies of a sweep with the same white noise, empty for a single cosmology
+std::vector<sweep_cosmology_t> sweep_cosmologies;
+
+//! whether a cosmology sweep was requested (this group of tasks may still have no cosmologies of it)
+bool bSweep{false};
+
+//! index of the cosmology currently generated
+size_t isweep{0};
+
+//! values of all swept keys in the config file, to reset them before the next cosmology (false if not set there)
+std::map<std::string, std::pair<bool, std::string>> sweep_base_values;
+
+//! k-space white noise of the first cosmology of a sweep, reused for all others
+std::unique_ptr<Grid_FFT<real_t>> sweep_wnoise;
+
+/**
+ * @brief Checks whether both members of a pair can be generated from one LPT computation
+ * 
+ * Inverting the phases negates the odd LPT orders (phi(1), phi(3), A(3)) and leaves phi(2) unchanged
+ * only for Gaussian ICs without external tides, otherwise orders are mixed.
+ * 
+ * @param the_config reference to config_file object
+ * @return true if GeneratePair is requested and possible
+ */
+bool generate_pair( config_file& the_config )
+{
+    if( !the_config.get_value_safe<bool>("setup", "GeneratePair", false) ) return false;
+
+    if( the_config.get_value_safe<double>("cosmology","fnl",0) != 0 || the_config.get_value_safe<double>("cosmology","gnl",0) != 0 ){
+        music::wlog << "GeneratePair requires Gaussian ICs (fnl=gnl=0), ignoring it. Run both members separately." << std::endl;
+        return false;
+    }
+    if( the_config.contains_key("cosmology", "LSS_aniso_lx") && the_config.contains_key("cosmology", "LSS_aniso_ly") 
+        && the_config.contains_key("cosmology", "LSS_aniso_lz") ){
+        music::wlog << "GeneratePair does not support external tides, ignoring it. Run both members separately." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Parses the list of starting redshifts, separated by commas or spaces
+ * 
+ * @param the_config reference to config_file object
+ * @return std::vector<double> starting redshifts in the order given
+ */
+std::vector<double> parse_zstart_list( config_file& the_config )
+{
+    std::string str = the_config.get_value<std::string>("setup", "zstart");
+    std::replace( str.begin(), str.end(), ',', ' ' );
+    std::stringstream ss( str );
+    std::vector<double> zlist;
+    double z;
+    while( ss >> z ) zlist.push_back( z );
+    if( zlist.empty() || !ss.eof() ){
+        music::elog << "Could not parse [setup]/zstart = '" << the_config.get_value<std::string>("setup", "zstart") << "'" << std::endl;
+        throw std::runtime_error("invalid zstart");
+    }
+    return zlist;
+}
+
+/**
+ * @brief Parses the seeds of an ensemble, from [random]/seeds (ranges a..b and single seeds, separated by commas
+ * or spaces) or from the whitespace separated list in [random]/SeedFile
+ * 
+ * @param the_config reference to config_file object
+ * @return std::vector<long> seeds, empty if no ensemble was requested
+ */
+std::vector<long> parse_ensemble_seeds( config_file& the_config )
+{
+    std::vector<long> seeds;
+    std::string str;
+    if( the_config.contains_key("random", "SeedFile") ){
+        const std::string fname = the_config.get_path_relative_to_config( the_config.get_value<std::string>("random", "SeedFile") );
+        std::ifstream ifs( fname );
+        if( !ifs.good() ){
+            music::elog << "Could not open seed file '" << fname << "'" << std::endl;
+            throw std::runtime_error("could not open seed file");
+        }
+        str.assign( std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>() );
+    }else if( the_config.contains_key("random", "seeds") ){
+        str = the_config.get_value<std::string>("random", "seeds");
+    }else{
+        return seeds;
+    }
+
+    std::replace( str.begin(), str.end(), ',', ' ' );
+    std::stringstream ss( str );
+    std::string token;
+    while( ss >> token ){
+        const size_t irange = token.find("..");
+        try{
+            if( irange == std::string::npos ){
+                seeds.push_back( std::stol(token) );
+            }else{
+                const long first = std::stol(token.substr(0, irange)), last = std::stol(token.substr(irange + 2));
+                for( long seed = first; seed <= last; ++seed ) seeds.push_back( seed );
+            }
+        }catch(...){
+            music::elog << "Could not parse seed '" << token << "' of ensemble" << std::endl;
+            throw std::runtime_error("invalid ensemble seed");
+        }
+    }
+
+    const std::string rngname = the_config.get_value<std::string>("random", "generator");
+    if( !seeds.empty() && rngname != "NGENIC" && rngname != "THREEFRY" ){
+        music::elog << "Ensembles of seeds need a generator with a single [random]/seed (NGENIC or THREEFRY), not " << rngname << std::endl;
+        throw std::runtime_error("ensemble not supported by RNG plugin");
+    }
+    return seeds;
+}
+
+/**
+ * @brief Parses the cosmologies of a sweep from [cosmology]/SweepFile, one cosmology per line given as whitespace 
+ * separated key=value pairs of the [cosmology] section, e.g. 'ParameterSet=none Omega_m=0.31 sigma_8=0.8'; 
+ * '#' starts a comment, empty lines are skipped
+ * 
+ * @param the_config reference to config_file object
+ * @return std::vector<sweep_cosmology_t> cosmologies, empty if no sweep was requested
+ */
+std::vector<sweep_cosmology_t> parse_sweep_cosmologies( config_file& the_config )
+{
+    std::vector<sweep_cosmology_t> cosmologies;
+    sweep_base_values.clear();
+    if( !the_config.contains_key("cosmology", "SweepFile") ) return cosmologies;
+
+    const std::string fname = the_config.get_path_relative_to_config( the_config.get_value<std::string>("cosmology", "SweepFile") );
+    std::ifstream ifs( fname );
+    if( !ifs.good() ){
+        music::elog << "Could not open cosmology sweep file '" << fname << "'" << std::endl;
+        throw std::runtime_error("could not open cosmology sweep file");
+    }
+
+    std::string line;
+    while( std::getline( ifs, line ) ){
+        line = line.substr( 0, line.find('#') );
+        std::stringstream ss( line );
+        std::string token;
+        sweep_cosmology_t c{ cosmologies.size(), {} };
+        while( ss >> token ){
+            const size_t ieq = token.find('=');
+            if( ieq == std::string::npos || ieq == 0 || ieq + 1 == token.size() ){
+                music::elog << "Could not parse '" << token << "' in cosmology sweep file, expected key=value" << std::endl;
+                throw std::runtime_error("invalid cosmology sweep file");
+            }
+            c.params.emplace_back( token.substr(0, ieq), token.substr(ieq + 1) );
+        }
+        if( !c.params.empty() ) cosmologies.push_back( c );
+    }
+    if( cosmologies.empty() ){
+        music::elog << "Cosmology sweep file '" << fname << "' contains no cosmologies" << std::endl;
+        throw std::runtime_error("empty cosmology sweep file");
+    }
+
+    //... remember the values from the config file, every cosmology starts from them
+    for( const auto& c : cosmologies ){
+        for( const auto& kv : c.params ){
+            if( sweep_base_values.count( kv.first ) ) continue;
+            const bool bset = the_config.contains_key("cosmology", kv.first);
+            sweep_base_values[kv.first] = { bset, bset? the_config.get_value<std::string>("cosmology", kv.first) : std::string() };
+        }
+    }
+    return cosmologies;
+}
+
+/**
+ * @brief Sets the [cosmology] keys of cosmology icosmo of the sweep in the config, before a calculator is created for it
+ */
+void configure_sweep_cosmology( config_file& the_config, size_t icosmo )
+{
+    for( const auto& kv : sweep_base_values ){
+        if( kv.second.first ) the_config.insert_value("cosmology", kv.first, kv.second.second);
+        else the_config.erase_value("cosmology", kv.first);
+    }
+    for( const auto& kv : sweep_cosmologies[icosmo].params )
+        the_config.insert_value("cosmology", kv.first, kv.second);
+}
+
+/**
+ * @brief Keeps the share of a list of realisations that this group of MPI tasks generates, every 
+ * CONFIG::MPI_num_groups-th element starting at the index of the group
+ */
+template< typename T >
+void select_group_share( std::vector<T>& list )
+{
+    if( CONFIG::MPI_num_groups < 2 ) return;
+    std::vector<T> share;
+    for( size_t i = size_t(CONFIG::MPI_group_index); i < list.size(); i += size_t(CONFIG::MPI_num_groups) )
+        share.push_back( list[i] );
+    list.swap( share );
+}
+
+/**
+ * @brief Suffix '_c<index>' of all files written for the current cosmology of a sweep, empty without a sweep
+ */
+std::string sweep_suffix( void )
+{
+    if( bSweep && isweep < sweep_cosmologies.size() ) return "_c" + std::to_string(sweep_cosmologies[isweep].id);
+    return std::string();
+}
+
+/**
+ * @brief Suffix of the output file for a starting redshift and pair member, '_s<seed>' for ensembles, '_c<index>' 
+ * for cosmology sweeps, '_A'/'_B' for pairs and '_z<zstart>' for lists
+ * 
+ * @param iz index into zstart_list
+ * @param imember 0 or 1, or -1 for files shared by both members of a pair (no '_A'/'_B')
+ * @return std::string suffix, empty if only one output is written
+ */
+std::string output_suffix( size_t iz, int imember )
+{
+    std::string suffix;
+    if( bEnsemble && iensemble < ensemble_seeds.size() ) suffix += "_s" + std::to_string(ensemble_seeds[iensemble]);
+    suffix += sweep_suffix();
+    if( bGeneratePair && imember >= 0 ) suffix += (imember == 0)? "_A" : "_B";
+    if( zstart_list.size() > 1 ){
+        char zstr[32];
+        snprintf( zstr, sizeof(zstr), "_z%g", zstart_list[iz] );
+        suffix += zstr;
+    }
+    return suffix;
+}
+
+/**
+ * @brief Inserts a suffix into the output file name, before the extension if there is one
+ * 
+ * @param fname output file name from the config file
+ * @param suffix suffix to insert
+ * @return std::string suffixed file name
+ */
+std::string suffixed_filename( const std::string& fname, const std::string& suffix )
+{
+    const size_t islash = fname.find_last_of('/');
+    const size_t idot = fname.find_last_of('.');
+    if( idot != std::string::npos && idot > 0 && (islash == std::string::npos || idot > islash + 1) )
+        return fname.substr(0, idot) + suffix + fname.substr(idot);
+    return fname + suffix;
+}
+
+/**
+ * @brief Sets the starting redshift and output file name in the config for output iz, imember
+ * 
+ * output plugins read both in their constructor, so this has to be called before one is created
+ */
+void configure_output( config_file& the_config, size_t iz, int imember )
+{
+    std::stringstream zstr;
+    zstr << std::setprecision(17) << zstart_list[iz];
+    the_config.insert_value("setup", "zstart", zstr.str());
+    //... with several output formats, the file names are a comma separated list
+    std::stringstream ss( output_filename );
+    std::string fname, fnames;
+    while( std::getline( ss, fname, ',' ) ){
+        fname.erase( fname.find_last_not_of(" \t") + 1 );
+        fname.erase( 0, fname.find_first_not_of(" \t") );
+        fnames += (fnames.empty()? "" : ", ") + suffixed_filename(fname, output_suffix(iz, imember));
+    }
+    the_config.insert_value("output", "filename", fnames);
+}
+
 /**
  * @brief Initialises all global objects
  * 
@@ -63,6 +350,48 @@ std::unique_ptr<cosmology::calculator>  the_cosmo_calc;
  */
 int initialise( config_file& the_config )
 {
+    //... the first output is configured before any object reads zstart or the output file name
+    zstart_list   = parse_zstart_list(the_config);
+    bGeneratePair = generate_pair(the_config);
+    ensemble_seeds = parse_ensemble_seeds(the_config);
+    bEnsemble = !ensemble_seeds.empty();
+    iensemble = 0;
+    sweep_cosmologies = parse_sweep_cosmologies(the_config);
+    bSweep = !sweep_cosmologies.empty();
+    isweep = 0;
+    if( bEnsemble && bSweep ){
+        music::elog << "An ensemble of seeds and a cosmology sweep cannot be combined, run the sweep for each seed" << std::endl;
+        throw std::runtime_error("ensemble and cosmology sweep");
+    }
+    if( bEnsemble ){
+        music::ilog << "Generating an ensemble of " << ensemble_seeds.size() << " realisations with shared setup" << std::endl;
+        //... with groups of MPI tasks, each group generates every CONFIG::MPI_num_groups-th seed
+        select_group_share( ensemble_seeds );
+        if( !ensemble_seeds.empty() )
+            the_config.insert_value("random", "seed", std::to_string(ensemble_seeds[0]));
+    }else if( bSweep ){
+        music::ilog << "Generating " << sweep_cosmologies.size() << " cosmologies with the same white noise" << std::endl;
+        select_group_share( sweep_cosmologies );
+        if( !sweep_cosmologies.empty() )
+            configure_sweep_cosmology( the_config, 0 );
+    }else if( CONFIG::MPI_num_groups > 1 ){
+        music::elog << "EnsembleGroups requires an ensemble of seeds ([random]/seeds or SeedFile) or a cosmology sweep" << std::endl;
+        throw std::runtime_error("EnsembleGroups without ensemble");
+    }
+    output_filename = the_config.get_value<std::string>("output", "filename");
+    if( (bEnsemble && ensemble_seeds.empty()) || (bSweep && sweep_cosmologies.empty()) ){
+        // more groups than seeds, nothing to do for this group apart from taking part in the setup,
+        // which still needs a single starting redshift in the config
+        configure_output(the_config, 0, 0);
+        the_cosmo_calc = std::make_unique<cosmology::calculator>(the_config);
+        return 0;
+    }
+    configure_output(the_config, 0, 0);
+    if( bGeneratePair || zstart_list.size() > 1 ){
+        music::ilog << "Writing " << zstart_list.size() * (bGeneratePair? 2 : 1) << " sets of ICs from one LPT computation, to '"
+                    << the_config.get_value<std::string>("output", "filename") << "' and similar" << std::endl;
+    }
+
     the_random_number_generator = std::move(select_RNG_plugin(the_config));
     the_cosmo_calc              = std::make_unique<cosmology::calculator>(the_config);
     the_output_plugin           = std::move(select_output_plugin(the_config, the_cosmo_calc));
@@ -75,19 +404,44 @@ int initialise( config_file& the_config )
  * 
  */
 void reset () {
+    free_fourier_copy_plans();
+    sweep_wnoise.reset();
     the_random_number_generator.reset();
     the_output_plugin.reset();
     the_cosmo_calc.reset();
 }
 
 
+#if defined(USE_CONVOLVER_ORSZAG)
+using convolver_t = OrszagConvolver<real_t>;
+#elif defined(USE_CONVOLVER_NAIVE)
+using convolver_t = NaiveConvolver<real_t>;
+#endif
+
+#if defined(ENABLE_PLT)
+using gradient_t = particle::lattice_gradient;
+#else
+using gradient_t = op::fourier_gradient;
+#endif
+
+/**
+ * @brief Objects that only depend on the grid and the particle load, created by the first realisation 
+ * and reused by all further realisations of an ensemble or cosmology sweep
+ */
+struct lpt_setup_t
+{
+    std::unique_ptr<convolver_t> conv; //!< convolver for the non-linear terms, with its buffers and FFTW plans
+    std::unique_ptr<gradient_t> lg;    //!< gradient operator, with the PLT eigenmodes and operator tables
+};
+
 /**
- * @brief Main driver routine for IC generation, everything interesting happens here
+ * @brief Generates the ICs of one realisation, everything interesting happens here
  * 
  * @param the_config reference to the config_file object
+ * @param setup convolver and gradient operator, created on first use and kept for the next realisation
  * @return int 0 if successful
  */
-int run( config_file& the_config )
+int run_realisation( config_file& the_config, lpt_setup_t& setup )
 {
     //--------------------------------------------------------------------------------------------------------
     // Read run parameters
@@ -127,6 +481,13 @@ int run( config_file& the_config )
         }
     #endif
 
+    //--------------------------------------------------------------------------------------------------------
+    //! number of independent 3LPT terms computed concurrently on thread sub-teams, and memory cap for their buffers
+    const int LPT_concurrent_terms = the_config.get_value_safe<int>("execution", "LPTConcurrentTerms", 1);
+    const size_t LPT_concurrent_memory = size_t(the_config.get_value_safe<double>("execution", "LPTConcurrentMemoryGB", 0.0) * 1024.0 * 1024.0 * 1024.0);
+    //! store A(3) as its two transverse components only, saves one full grid with 3LPT
+    const bool bCompactA3 = the_config.get_value_safe<bool>("execution", "CompactA3", false);
+
     //--------------------------------------------------------------------------------------------------------
     //! initialice particles on a bcc or fcc lattice instead of a standard sc lattice (doubles and quadruples the number of particles) 
     std::string lattice_str = the_config.get_value_safe<std::string>("setup","ParticleLoad","sc");
@@ -209,8 +570,9 @@ int run( config_file& the_config )
     const real_t astart = 1.0/(1.0+zstart);
     const real_t volfac(std::pow(boxlen / ngrid / 2.0 / M_PI, 1.5));
 
-    the_cosmo_calc->write_powerspectrum(astart, the_config.get_path_relative_to_config("input_powerspec.txt"));
-    the_cosmo_calc->write_transfer(the_config.get_path_relative_to_config("input_transfer.txt"));
+    // input spectra carry the suffix of the outputs (seed, cosmology, redshift), they are shared by a pair
+    the_cosmo_calc->write_powerspectrum(astart, the_config.get_path_relative_to_config(suffixed_filename("input_powerspec.txt", output_suffix(0, -1))));
+    the_cosmo_calc->write_transfer(the_config.get_path_relative_to_config(suffixed_filename("input_transfer.txt", output_suffix(0, -1))));
 
     // the_cosmo_calc->compute_sigma_bc();
     // abort();
@@ -218,46 +580,156 @@ int run( config_file& the_config )
     //--------------------------------------------------------------------
     // Compute LPT time coefficients
     //--------------------------------------------------------------------
-    const real_t Dplus0 = the_cosmo_calc->get_growth_factor(astart);
-    const real_t vfac   = the_cosmo_calc->get_vfact(astart);
-
-    const real_t g1  = -Dplus0;
-    const real_t g2  = ((LPTorder>1)? -3.0/7.0*Dplus0*Dplus0 : 0.0);
-    const real_t g3  = ((LPTorder>2)? 1.0/3.0*Dplus0*Dplus0*Dplus0 : 0.0);
-    const real_t g3c = ((LPTorder>2)? 1.0/7.0*Dplus0*Dplus0*Dplus0 : 0.0);
-
-    // vfac = d log D+ / dt 
-    // d(D+^2)/dt = 2*D+ * d D+/dt = 2 * D+^2 * vfac
-    // d(D+^3)/dt = 3*D+^2* d D+/dt = 3 * D+^3 * vfac
-    const real_t vfac1 =  vfac;
-    const real_t vfac2 =  2*vfac;
-    const real_t vfac3 =  3*vfac;
-
-    // anisotropic velocity growth factor for external tides
-    // cf. eq. (5) of Stuecker et al. 2020 (https://arxiv.org/abs/2003.06427)
-    const std::array<real_t,3> lss_aniso_alpha = {
-        real_t(1.0) - Dplus0 * lss_aniso_lambda[0],
-        real_t(1.0) - Dplus0 * lss_aniso_lambda[1],
-        real_t(1.0) - Dplus0 * lss_aniso_lambda[2],
+    //... not const: with a list of starting redshifts, they are set again for each output
+    real_t Dplus0, vfac, g1, g2, g3, g3c, vfac1, vfac2, vfac3;
+    std::array<real_t,3> lss_aniso_alpha;
+
+    auto set_time_coefficients = [&]( real_t a ){
+        Dplus0 = the_cosmo_calc->get_growth_factor(a);
+        vfac   = the_cosmo_calc->get_vfact(a);
+
+        g1  = -Dplus0;
+        g2  = ((LPTorder>1)? -3.0/7.0*Dplus0*Dplus0 : 0.0);
+        g3  = ((LPTorder>2)? 1.0/3.0*Dplus0*Dplus0*Dplus0 : 0.0);
+        g3c = ((LPTorder>2)? 1.0/7.0*Dplus0*Dplus0*Dplus0 : 0.0);
+
+        // vfac = d log D+ / dt 
+        // d(D+^2)/dt = 2*D+ * d D+/dt = 2 * D+^2 * vfac
+        // d(D+^3)/dt = 3*D+^2* d D+/dt = 3 * D+^3 * vfac
+        vfac1 =  vfac;
+        vfac2 =  2*vfac;
+        vfac3 =  3*vfac;
+
+        // anisotropic velocity growth factor for external tides
+        // cf. eq. (5) of Stuecker et al. 2020 (https://arxiv.org/abs/2003.06427)
+        lss_aniso_alpha = {{
+            real_t(1.0) - Dplus0 * lss_aniso_lambda[0],
+            real_t(1.0) - Dplus0 * lss_aniso_lambda[1],
+            real_t(1.0) - Dplus0 * lss_aniso_lambda[2],
+        }};
     };
+    set_time_coefficients( astart );
 
     //--------------------------------------------------------------------
     // Create arrays
     //--------------------------------------------------------------------
 
+    //... second member of a pair, phases are inverted with respect to DoInversion
+    bool bPairInverted = false;
+
+    //... fill a grid with the Gaussian white noise field in k-space, including constrained modes, 
+    //... fixing, inversion and normalisation; repeatable generators can call this again on demand
+    auto generate_white_noise = [&]( Grid_FFT<real_t>& wnoise ){
+        //... in a cosmology sweep, all but the first cosmology copy the noise kept from it
+        if( sweep_wnoise ){
+            wnoise.copy_from( *sweep_wnoise );
+            if( bPairInverted ) wnoise *= real_t(-1.0);
+            return;
+        }
+
+        the_random_number_generator->Fill_Grid(wnoise);
+
+        wnoise.FourierTransformForward();
+
+        //--------------------------------------------------------------------
+        // Use externally specified large scale modes from constraints in case
+        // TODO: move to separate routine
+        //--------------------------------------------------------------------
+        if( bAddConstrainedModes ){
+            Grid_FFT<real_t,false> cwnoise({8,8,8}, {boxlen,boxlen,boxlen});
+            cwnoise.Read_from_HDF5( the_config.get_value<std::string>("random", "ConstraintFieldFile"), 
+                    the_config.get_value<std::string>("random", "ConstraintFieldName") );
+            cwnoise.FourierTransformForward();
+
+            size_t ngrid_c = cwnoise.size(0), ngrid_c_2 = ngrid_c/2;
+
+            // TODO: copy over modes
+            double rs1{0.0},rs2{0.0},is1{0.0},is2{0.0};
+            double nrs1{0.0},nrs2{0.0},nis1{0.0},nis2{0.0};
+            size_t count{0};
+
+            #pragma omp parallel for reduction(+:rs1,rs2,is1,is2,nrs1,nrs2,nis1,nis2,count)
+            for( size_t i=0; i<ngrid_c; ++i ){
+                size_t il = size_t(-1);
+                if( i<ngrid_c_2 && i<ngrid/2 ) il = i;
+                if( i>ngrid_c_2 && i+ngrid-ngrid_c>ngrid/2) il = ngrid-ngrid_c+i;
+                if( il == size_t(-1) ) continue;
+                if( il<size_t(wnoise.local_1_start_) || il>=size_t(wnoise.local_1_start_+wnoise.local_1_size_)) continue;
+                il -= wnoise.local_1_start_;
+                for( size_t j=0; j<ngrid_c; ++j ){
+                    size_t jl = size_t(-1);
+                    if( j<ngrid_c_2 && j<ngrid/2 ) jl = j;
+                    if( j>ngrid_c_2 && j+ngrid-ngrid_c>ngrid/2 ) jl = ngrid-ngrid_c+j;
+                    if( jl == size_t(-1) ) continue;
+                    for( size_t k=0; k<ngrid_c/2+1; ++k ){
+                        if( k>ngrid/2 ) continue;
+                        size_t kl = k;
+
+                        ++count;
+
+                        nrs1 += std::real(cwnoise.kelem(i,j,k));
+                        nrs2 += std::real(cwnoise.kelem(i,j,k))*std::real(cwnoise.kelem(i,j,k));
+                        nis1 += std::imag(cwnoise.kelem(i,j,k));
+                        nis2 += std::imag(cwnoise.kelem(i,j,k))*std::imag(cwnoise.kelem(i,j,k));
+
+                        rs1 += std::real(wnoise.kelem(il,jl,kl));
+                        rs2 += std::real(wnoise.kelem(il,jl,kl))*std::real(wnoise.kelem(il,jl,kl));
+                        is1 += std::imag(wnoise.kelem(il,jl,kl));
+                        is2 += std::imag(wnoise.kelem(il,jl,kl))*std::imag(wnoise.kelem(il,jl,kl));
+
+                    #if defined(USE_MPI)
+                        wnoise.kelem(il,jl,kl) = cwnoise.kelem(j,i,k);
+                    #else
+                        wnoise.kelem(il,jl,kl) = cwnoise.kelem(i,j,k);
+                    #endif
+                    }
+                }
+            }
+
+            // music::ilog << "  ... old field: re <w>=" << rs1/count << " <w^2>-<w>^2=" << rs2/count-rs1*rs1/count/count << std::endl;
+            // music::ilog << "  ... old field: im <w>=" << is1/count << " <w^2>-<w>^2=" << is2/count-is1*is1/count/count << std::endl;
+            // music::ilog << "  ... new field: re <w>=" << nrs1/count << " <w^2>-<w>^2=" << nrs2/count-nrs1*nrs1/count/count << std::endl;
+            // music::ilog << "  ... new field: im <w>=" << nis1/count << " <w^2>-<w>^2=" << nis2/count-nis1*nis1/count/count << std::endl;
+            music::ilog << "White noise field large-scale modes overwritten with external field." << std::endl;
+        }
+
+        //--------------------------------------------------------------------
+        // Apply Normalisation factor and Angulo&Pontzen fixing or not
+        //--------------------------------------------------------------------
+
+        wnoise.apply_function_k( [&](auto wn){
+            if (bDoFixing){
+                wn = (std::fabs(wn) != 0.0) ? wn / std::fabs(wn) : wn;
+            }
+            return ((bDoInversion != bPairInverted)? real_t{-1.0} : real_t{1.0}) * wn / volfac;
+        });
+
+        if( bSweep && !bPairInverted ){
+            sweep_wnoise = std::make_unique<Grid_FFT<real_t>>( std::array<size_t,3>{ngrid, ngrid, ngrid}, std::array<real_t,3>{boxlen, boxlen, boxlen} );
+            sweep_wnoise->copy_from( wnoise );
+        }
+    };
+
+    //... if the generator gives the same field again when called twice, phi is computed in place on the
+    //... white noise grid, which is regenerated later only if the baryon terms need it
+    bool bNoiseInPlace = the_config.get_value_safe<bool>("execution", "ReuseNoiseForPhi", false);
+    if( bNoiseInPlace && !bSweep && !the_random_number_generator->isRepeatable() ){
+        music::wlog << "RNG plugin cannot regenerate its white noise, ignoring ReuseNoiseForPhi." << std::endl;
+        bNoiseInPlace = false;
+    }
+
     // white noise field 
     Grid_FFT<real_t> wnoise({ngrid, ngrid, ngrid}, {boxlen, boxlen, boxlen});
 
     //... Fill the wnoise grid with a Gaussian white noise field, we do this first since the RNG might need extra memory
     music::ilog << "-------------------------------------------------------------------------------" << std::endl;
-    music::ilog << "Generating white noise field...." << std::endl;
+    music::ilog << (sweep_wnoise? "Copying white noise field of the sweep...." : "Generating white noise field....") << std::endl;
 
-    the_random_number_generator->Fill_Grid(wnoise);
-    
-    wnoise.FourierTransformForward();
+    generate_white_noise( wnoise );
 
     //... Next, declare LPT related arrays, allocated only as needed by order
-    Grid_FFT<real_t> phi({ngrid, ngrid, ngrid}, {boxlen, boxlen, boxlen});
+    Grid_FFT<real_t> phi_buffer({ngrid, ngrid, ngrid}, {boxlen, boxlen, boxlen}, !bNoiseInPlace);
+    Grid_FFT<real_t> &phi = bNoiseInPlace ? wnoise : phi_buffer; // phi overwrites the white noise in place
     Grid_FFT<real_t> phi2({ngrid, ngrid, ngrid}, {boxlen, boxlen, boxlen}, false); // do not allocate these unless needed
     Grid_FFT<real_t> delta_power({ngrid, ngrid, ngrid}, {boxlen, boxlen, boxlen}, false); // TOMA
 
@@ -268,83 +740,22 @@ int run( config_file& the_config )
 
     //... array [.] access to components of A3:
     std::array<Grid_FFT<real_t> *, 3> A3({&A3x, &A3y, &A3z});
+    bool bA3transverse = false; // A3x, A3y hold the transverse components, A3z is not allocated
 
     // temporary storage of additional data
     Grid_FFT<real_t> tmp({ngrid, ngrid, ngrid}, {boxlen, boxlen, boxlen});
 
-    //--------------------------------------------------------------------
-    // Use externally specified large scale modes from constraints in case
-    // TODO: move to separate routine
-    //--------------------------------------------------------------------
-    if( bAddConstrainedModes ){
-        Grid_FFT<real_t,false> cwnoise({8,8,8}, {boxlen,boxlen,boxlen});
-        cwnoise.Read_from_HDF5( the_config.get_value<std::string>("random", "ConstraintFieldFile"), 
-                the_config.get_value<std::string>("random", "ConstraintFieldName") );
-        cwnoise.FourierTransformForward();
-
-        size_t ngrid_c = cwnoise.size(0), ngrid_c_2 = ngrid_c/2;
-
-        // TODO: copy over modes
-        double rs1{0.0},rs2{0.0},is1{0.0},is2{0.0};
-        double nrs1{0.0},nrs2{0.0},nis1{0.0},nis2{0.0};
-        size_t count{0};
-
-        #pragma omp parallel for reduction(+:rs1,rs2,is1,is2,nrs1,nrs2,nis1,nis2,count)
-        for( size_t i=0; i<ngrid_c; ++i ){
-            size_t il = size_t(-1);
-            if( i<ngrid_c_2 && i<ngrid/2 ) il = i;
-            if( i>ngrid_c_2 && i+ngrid-ngrid_c>ngrid/2) il = ngrid-ngrid_c+i;
-            if( il == size_t(-1) ) continue;
-            if( il<size_t(wnoise.local_1_start_) || il>=size_t(wnoise.local_1_start_+wnoise.local_1_size_)) continue;
-            il -= wnoise.local_1_start_;
-            for( size_t j=0; j<ngrid_c; ++j ){
-                size_t jl = size_t(-1);
-                if( j<ngrid_c_2 && j<ngrid/2 ) jl = j;
-                if( j>ngrid_c_2 && j+ngrid-ngrid_c>ngrid/2 ) jl = ngrid-ngrid_c+j;
-                if( jl == size_t(-1) ) continue;
-                for( size_t k=0; k<ngrid_c/2+1; ++k ){
-                    if( k>ngrid/2 ) continue;
-                    size_t kl = k;
-                    
-                    ++count;
-
-                    nrs1 += std::real(cwnoise.kelem(i,j,k));
-                    nrs2 += std::real(cwnoise.kelem(i,j,k))*std::real(cwnoise.kelem(i,j,k));
-                    nis1 += std::imag(cwnoise.kelem(i,j,k));
-                    nis2 += std::imag(cwnoise.kelem(i,j,k))*std::imag(cwnoise.kelem(i,j,k));
-
-                    rs1 += std::real(wnoise.kelem(il,jl,kl));
-                    rs2 += std::real(wnoise.kelem(il,jl,kl))*std::real(wnoise.kelem(il,jl,kl));
-                    is1 += std::imag(wnoise.kelem(il,jl,kl));
-                    is2 += std::imag(wnoise.kelem(il,jl,kl))*std::imag(wnoise.kelem(il,jl,kl));
-                    
-                #if defined(USE_MPI)
-                    wnoise.kelem(il,jl,kl) = cwnoise.kelem(j,i,k);
-                #else
-                    wnoise.kelem(il,jl,kl) = cwnoise.kelem(i,j,k);
-                #endif
-                }
-            }
+    //... white noise for the terms that need it after phi(1) was computed, regenerated once if phi took its place
+    Grid_FFT<real_t> wnoise_regen({ngrid, ngrid, ngrid}, {boxlen, boxlen, boxlen}, false);
+    auto white_noise = [&]( void ) -> Grid_FFT<real_t>& {
+        if( !bNoiseInPlace ) return wnoise;
+        if( !wnoise_regen.is_allocated() ){
+            music::ilog << "Regenerating white noise field...." << std::endl;
+            wnoise_regen.allocate();
+            generate_white_noise( wnoise_regen );
         }
-
-        // music::ilog << "  ... old field: re <w>=" << rs1/count << " <w^2>-<w>^2=" << rs2/count-rs1*rs1/count/count << std::endl;
-        // music::ilog << "  ... old field: im <w>=" << is1/count << " <w^2>-<w>^2=" << is2/count-is1*is1/count/count << std::endl;
-        // music::ilog << "  ... new field: re <w>=" << nrs1/count << " <w^2>-<w>^2=" << nrs2/count-nrs1*nrs1/count/count << std::endl;
-        // music::ilog << "  ... new field: im <w>=" << nis1/count << " <w^2>-<w>^2=" << nis2/count-nis1*nis1/count/count << std::endl;
-        music::ilog << "White noise field large-scale modes overwritten with external field." << std::endl;
-    }
-
-    //--------------------------------------------------------------------
-    // Apply Normalisation factor and Angulo&Pontzen fixing or not
-    //--------------------------------------------------------------------
-
-    wnoise.apply_function_k( [&](auto wn){
-        if (bDoFixing){
-            wn = (std::fabs(wn) != 0.0) ? wn / std::fabs(wn) : wn;
-        }
-        return ((bDoInversion)? real_t{-1.0} : real_t{1.0}) * wn / volfac;
-    });
-
+        return wnoise_regen;
+    };
 
     //--------------------------------------------------------------------
     // Compute the LPT terms....
@@ -353,21 +764,21 @@ int run( config_file& the_config )
     //--------------------------------------------------------------------
     // Create convolution class instance for non-linear terms
     //--------------------------------------------------------------------
-#if defined(USE_CONVOLVER_ORSZAG)
-    OrszagConvolver<real_t> Conv({ngrid, ngrid, ngrid}, {boxlen, boxlen, boxlen});
-#elif defined(USE_CONVOLVER_NAIVE)
-    NaiveConvolver<real_t> Conv({ngrid, ngrid, ngrid}, {boxlen, boxlen, boxlen});
-#endif
+    if( !setup.conv ){
+        setup.conv = std::make_unique<convolver_t>( std::array<size_t,3>{ngrid, ngrid, ngrid}, std::array<real_t,3>{boxlen, boxlen, boxlen} );
+    }
+    convolver_t &Conv = *setup.conv;
     //--------------------------------------------------------------------
 
     //--------------------------------------------------------------------
     // Create PLT gradient operator
     //--------------------------------------------------------------------
-#if defined(ENABLE_PLT)
-    particle::lattice_gradient lg( the_config );
-#else
-    op::fourier_gradient lg( the_config );
-#endif
+    if( !setup.lg ){
+        setup.lg = std::make_unique<gradient_t>( the_config );
+        // tabulate operator once, it is reused for all components, species and realisations
+        setup.lg->precompute( tmp );
+    }
+    const gradient_t &lg = *setup.lg;
 
     //--------------------------------------------------------------------
     std::vector<cosmo_species> species_list;
@@ -501,48 +912,67 @@ int run( config_file& the_config )
     //======================================================================
     if (LPTorder > 2)
     {
+        //... all outputs are allocated up front, so that independent terms can be computed concurrently
         phi3.allocate();
         phi3.FourierTransformForward(false);
+        //... with compact A(3), its z-component is computed into tmp (already allocated) and only lives until it is compressed
+        if (bCompactA3)
+            A3[2] = &tmp;
+        for (int idim = 0; idim < 3; ++idim)
+        {
+            if (!A3[idim]->is_allocated())
+                A3[idim]->allocate();
+            A3[idim]->FourierTransformForward(false);
+        }
+        phi.FourierTransformForward();
+        phi2.FourierTransformForward();
+
+        lpt_task_graph<convolver_t> lpt3_terms;
 
-        
         //... phi3 = phi3a - 10/7 phi3b
         //... 3a term ...
-        wtime = get_wtime();
-        music::ilog << std::setw(79) << std::setfill('.') << std::left << ">> Computing phi(3a) term" << std::endl;
-        Conv.convolve_Hessians(phi, {0, 0}, phi, {1, 1}, phi, {2, 2}, op::assign_to(phi3));
-        Conv.convolve_Hessians(phi, {0, 1}, phi, {0, 2}, phi, {1, 2}, op::multiply_add_to(phi3,2.0));
-        Conv.convolve_Hessians(phi, {1, 2}, phi, {1, 2}, phi, {0, 0}, op::subtract_from(phi3));
-        Conv.convolve_Hessians(phi, {0, 2}, phi, {0, 2}, phi, {1, 1}, op::subtract_from(phi3));
-        Conv.convolve_Hessians(phi, {0, 1}, phi, {0, 1}, phi, {2, 2}, op::subtract_from(phi3));
-        // phi3a.apply_InverseLaplacian();
-        music::ilog << std::setw(70) << std::setfill(' ') << std::right << "took : " << std::setw(8) << get_wtime() - wtime << "s" << std::endl;
-
-        //... 3b term ...
-        wtime = get_wtime();
-        music::ilog << std::setw(71) << std::setfill('.') << std::left << ">> Computing phi(3b) term" << std::endl;
-        Conv.convolve_SumOfHessians(phi, {0, 0}, phi2, {1, 1}, {2, 2}, op::multiply_add_to(phi3,-5.0/7.0));
-        Conv.convolve_SumOfHessians(phi, {1, 1}, phi2, {2, 2}, {0, 0}, op::multiply_add_to(phi3,-5.0/7.0));
-        Conv.convolve_SumOfHessians(phi, {2, 2}, phi2, {0, 0}, {1, 1}, op::multiply_add_to(phi3,-5.0/7.0));
-        Conv.convolve_Hessians(phi, {0, 1}, phi2, {0, 1}, op::multiply_add_to(phi3,+10.0/7.0));
-        Conv.convolve_Hessians(phi, {0, 2}, phi2, {0, 2}, op::multiply_add_to(phi3,+10.0/7.0));
-        Conv.convolve_Hessians(phi, {1, 2}, phi2, {1, 2}, op::multiply_add_to(phi3,+10.0/7.0));
-        phi3.apply_InverseLaplacian();
-        music::ilog << std::setw(70) << std::setfill(' ') << std::right << "took : " << std::setw(8) << get_wtime() - wtime << "s" << std::endl;
+        const size_t task_phi3a = lpt3_terms.add_task("phi(3a)", {}, [&](auto &conv) {
+            conv.convolve_Hessians(phi, {0, 0}, phi, {1, 1}, phi, {2, 2}, op::assign_to(phi3));
+            conv.convolve_Hessians(phi, {0, 1}, phi, {0, 2}, phi, {1, 2}, op::multiply_add_to(phi3,2.0));
+            conv.convolve_Hessians(phi, {1, 2}, phi, {1, 2}, phi, {0, 0}, op::subtract_from(phi3));
+            conv.convolve_Hessians(phi, {0, 2}, phi, {0, 2}, phi, {1, 1}, op::subtract_from(phi3));
+            conv.convolve_Hessians(phi, {0, 1}, phi, {0, 1}, phi, {2, 2}, op::subtract_from(phi3));
+        });
+
+        //... 3b term, accumulates into the same field ...
+        lpt3_terms.add_task("phi(3b)", {task_phi3a}, [&](auto &conv) {
+            conv.convolve_SumOfHessians(phi, {0, 0}, phi2, {1, 1}, {2, 2}, op::multiply_add_to(phi3,-5.0/7.0));
+            conv.convolve_SumOfHessians(phi, {1, 1}, phi2, {2, 2}, {0, 0}, op::multiply_add_to(phi3,-5.0/7.0));
+            conv.convolve_SumOfHessians(phi, {2, 2}, phi2, {0, 0}, {1, 1}, op::multiply_add_to(phi3,-5.0/7.0));
+            conv.convolve_Hessians(phi, {0, 1}, phi2, {0, 1}, op::multiply_add_to(phi3,+10.0/7.0));
+            conv.convolve_Hessians(phi, {0, 2}, phi2, {0, 2}, op::multiply_add_to(phi3,+10.0/7.0));
+            conv.convolve_Hessians(phi, {1, 2}, phi2, {1, 2}, op::multiply_add_to(phi3,+10.0/7.0));
+            phi3.apply_InverseLaplacian();
+        });
 
         //... transversal term ...
-        wtime = get_wtime();
-        music::ilog << std::setw(71) << std::setfill('.') << std::left << ">> Computing A(3) term" << std::endl;
         for (int idim = 0; idim < 3; ++idim)
         {
-            // cyclic rotations of indices
-            int idimp = (idim + 1) % 3, idimpp = (idim + 2) % 3;
-            A3[idim]->allocate();
-            A3[idim]->FourierTransformForward(false);
-            Conv.convolve_Hessians(phi2, {idim, idimp}, phi, {idim, idimpp}, op::assign_to(*A3[idim]));
-            Conv.convolve_Hessians(phi2, {idim, idimpp}, phi, {idim, idimp}, op::subtract_from(*A3[idim]));
-            Conv.convolve_DifferenceOfHessians(phi, {idimp, idimpp}, phi2, {idimp, idimp}, {idimpp, idimpp}, op::add_to(*A3[idim]));
-            Conv.convolve_DifferenceOfHessians(phi2, {idimp, idimpp}, phi, {idimp, idimp}, {idimpp, idimpp}, op::subtract_from(*A3[idim]));
-            A3[idim]->apply_InverseLaplacian();
+            const std::string name = std::string("A(3)_") + "xyz"[idim];
+            lpt3_terms.add_task(name, {}, [&, idim](auto &conv) {
+                // cyclic rotations of indices
+                int idimp = (idim + 1) % 3, idimpp = (idim + 2) % 3;
+                conv.convolve_Hessians(phi2, {idim, idimp}, phi, {idim, idimpp}, op::assign_to(*A3[idim]));
+                conv.convolve_Hessians(phi2, {idim, idimpp}, phi, {idim, idimp}, op::subtract_from(*A3[idim]));
+                conv.convolve_DifferenceOfHessians(phi, {idimp, idimpp}, phi2, {idimp, idimp}, {idimpp, idimpp}, op::add_to(*A3[idim]));
+                conv.convolve_DifferenceOfHessians(phi2, {idimp, idimpp}, phi, {idimp, idimp}, {idimpp, idimpp}, op::subtract_from(*A3[idim]));
+                A3[idim]->apply_InverseLaplacian();
+            });
+        }
+
+        wtime = get_wtime();
+        music::ilog << std::setw(71) << std::setfill('.') << std::left << ">> Computing phi(3) and A(3) terms" << std::endl;
+        lpt3_terms.execute(Conv, {ngrid, ngrid, ngrid}, {boxlen, boxlen, boxlen}, LPT_concurrent_terms, LPT_concurrent_memory);
+        if (bCompactA3)
+        {
+            lpt_kernels::compress_transverse(*A3[0], *A3[1], *A3[2]);
+            A3[2] = &A3z;
+            bA3transverse = true;
         }
         music::ilog << std::setw(70) << std::setfill(' ') << std::right << "took : " << std::setw(8) << get_wtime() - wtime << "s" << std::endl;
     }
@@ -560,9 +990,21 @@ int run( config_file& the_config )
         phi3 *= g3;
         (*A3[0]) *= g3c;
         (*A3[1]) *= g3c;
-        (*A3[2]) *= g3c;
+        if (!bA3transverse)
+            (*A3[2]) *= g3c;
     }
 
+    //... restore all three components of A(3) where they are needed explicitly
+    auto expand_A3 = [&]( void ){
+        if (!bA3transverse) return;
+        A3[0]->FourierTransformForward();
+        A3[1]->FourierTransformForward();
+        A3[2]->allocate();
+        A3[2]->FourierTransformForward(false);
+        lpt_kernels::expand_transverse(*A3[0], *A3[1], *A3[2]);
+        bA3transverse = false;
+    };
+
     music::ilog << "-------------------------------------------------------------------------------" << std::endl;
 
     ///////////////////////////////////////////////////////////////////////
@@ -575,14 +1017,15 @@ int run( config_file& the_config )
     if (testing != "none")
     {
         music::wlog << "you are running in testing mode. No ICs, only diagnostic output will be written out!" << std::endl;
+        expand_A3();
         if (testing == "potentials_and_densities"){
-            testing::output_potentials_and_densities(the_config, ngrid, boxlen, phi, phi2, phi3, A3);
+            testing::output_potentials_and_densities(the_config, output_suffix(0, -1), ngrid, boxlen, phi, phi2, phi3, A3);
         }
         else if (testing == "velocity_displacement_symmetries"){
-            testing::output_velocity_displacement_symmetries(the_config, ngrid, boxlen, vfac, Dplus0, phi, phi2, phi3, A3);
+            testing::output_velocity_displacement_symmetries(the_config, output_suffix(0, -1), ngrid, boxlen, vfac, Dplus0, phi, phi2, phi3, A3);
         }
         else if (testing == "convergence"){
-            testing::output_convergence(the_config, the_cosmo_calc.get(), ngrid, boxlen, vfac, Dplus0, phi, phi2, phi3, A3);
+            testing::output_convergence(the_config, output_suffix(0, -1), the_cosmo_calc.get(), ngrid, boxlen, vfac, Dplus0, phi, phi2, phi3, A3);
         }
         else{
             music::flog << "unknown test '" << testing << "'" << std::endl;
@@ -603,392 +1046,498 @@ int run( config_file& the_config )
     //     ofs.close();
     // }
 
+    //... buffers of the LPT stage (lane convolvers, padded transients) are not requested again
+    numa_memory::pool_trim();
+
     //==============================================================//
-    // main output loop, loop over all species that are enabled
+    // ICs are written for each starting redshift, by rescaling the
+    // potentials, and with GeneratePair a second time for the member
+    // with inverted phases: odd orders change sign, phi(2) not
     //==============================================================//
-    for( const auto& this_species : species_list )
+    const int nmembers = bGeneratePair? 2 : 1;
+    for( size_t iout=0; iout<zstart_list.size()*nmembers; ++iout )
     {
-        music::ilog << std::endl
-                    << ">>> Computing ICs for species \'" << cosmo_species_name[this_species] << "\' <<<\n" << std::endl;
+        const size_t iz = iout / nmembers;
+        const int imember = int(iout % nmembers);
+
+        if( iout > 0 && imember == 0 ){
+            music::ilog << std::endl << ">>> Rescaling LPT potentials to zstart = " << zstart_list[iz] << " <<<\n" << std::endl;
+            const real_t g1old = g1, g2old = g2, g3old = g3, g3cold = g3c;
+            const real_t anew = 1.0/(1.0+zstart_list[iz]);
+            the_cosmo_calc->set_starting_scale_factor( anew );
+            set_time_coefficients( anew );
+            the_cosmo_calc->write_powerspectrum(anew, the_config.get_path_relative_to_config(suffixed_filename("input_powerspec.txt", output_suffix(iz, -1))));
+
+            // the potentials only scale with powers of D+, the baryon terms are evaluated at the new time
+            phi *= g1/g1old;
+            if( LPTorder > 1 ){
+                phi2 *= g2/g2old;
+            }
+            if( LPTorder > 2 ){
+                phi3 *= g3/g3old;
+                for( int idim=0; idim<(bA3transverse? 2 : 3); ++idim ){
+                    (*A3[idim]) *= g3c/g3cold;
+                }
+            }
+        }
 
-        // const real_t C_species = (this_species == cosmo_species::baryon)? (1.0-the_cosmo_calc->cosmo_param_["f_b"]) : -the_cosmo_calc->cosmo_param_["f_b"];
+        if( (imember == 1) != bPairInverted ){
+            if( imember == 1 ){
+                music::ilog << std::endl << ">>> Writing second member of the pair, with inverted phases <<<\n" << std::endl;
+            }
+            bPairInverted = (imember == 1);
 
-        real_t C_species = (this_species == cosmo_species::baryon)? (1.0-the_cosmo_calc->cosmo_param_["f_b"]) : -the_cosmo_calc->cosmo_param_["f_b"];
+            phi *= real_t(-1.0);
+            if( LPTorder > 2 ){
+                phi3 *= real_t(-1.0);
+                for( int idim=0; idim<(bA3transverse? 2 : 3); ++idim ){
+                    (*A3[idim]) *= real_t(-1.0);
+                }
+            }
+            // with ReuseNoiseForPhi, wnoise is phi and was inverted above, a noise field not yet regenerated gets the new sign
+            if( !bNoiseInPlace ){
+                wnoise *= real_t(-1.0);
+            }else if( wnoise_regen.is_allocated() ){
+                wnoise_regen *= real_t(-1.0);
+            }
+        }
 
-        if( species_list.size() == 1 ){
-            C_species = 0.0;
+        if( iout > 0 ){
+            // the previous output is finalised when its plugin is destroyed
+            the_output_plugin.reset();
+            configure_output( the_config, iz, imember );
+            the_output_plugin = std::move(select_output_plugin(the_config, the_cosmo_calc));
         }
 
-        // main loop block
+        //==============================================================//
+        // main output loop, loop over all species that are enabled
+        //==============================================================//
+        for( const auto& this_species : species_list )
         {
-            std::unique_ptr<particle::lattice_generator<Grid_FFT<real_t>>> particle_lattice_generator_ptr;
+            music::ilog << std::endl
+                        << ">>> Computing ICs for species \'" << cosmo_species_name[this_species] << "\' <<<\n" << std::endl;
 
-            // if output plugin wants particles, then we need to store them, along with their IDs
-            if( the_output_plugin->write_species_as( this_species ) == output_type::particles )
-            {
-                // somewhat arbitrarily, start baryon particle IDs from 2**31 if we have 32bit and from 2**56 if we have 64 bits
-                size_t IDoffset = (this_species == cosmo_species::baryon)? ((the_output_plugin->has_64bit_ids())? 1 : 1): 0 ;
+            // const real_t C_species = (this_species == cosmo_species::baryon)? (1.0-the_cosmo_calc->cosmo_param_["f_b"]) : -the_cosmo_calc->cosmo_param_["f_b"];
 
-                // allocate particle structure and generate particle IDs
-                bool secondary_lattice = (this_species == cosmo_species::baryon &&
-                                        the_output_plugin->write_species_as(this_species) == output_type::particles) ? true : false;
+            real_t C_species = (this_species == cosmo_species::baryon)? (1.0-the_cosmo_calc->cosmo_param_["f_b"]) : -the_cosmo_calc->cosmo_param_["f_b"];
 
-                particle_lattice_generator_ptr = 
-                std::make_unique<particle::lattice_generator<Grid_FFT<real_t>>>( lattice_type, secondary_lattice, the_output_plugin->has_64bit_reals(), the_output_plugin->has_64bit_ids(), 
-                    bDoBaryons, IDoffset, tmp, the_config );
+            if( species_list.size() == 1 ){
+                C_species = 0.0;
             }
 
-            // set the perturbed particle masses if we have baryons
-            if( bDoBaryons && (the_output_plugin->write_species_as( this_species ) == output_type::particles
-                || the_output_plugin->write_species_as( this_species ) == output_type::field_lagrangian) ) 
+            // main loop block
             {
-                bool secondary_lattice = (this_species == cosmo_species::baryon &&
-                                        the_output_plugin->write_species_as(this_species) == output_type::particles) ? true : false;
-
-                const real_t munit = the_output_plugin->mass_unit();
-
-                //======================================================================
-                // initialise rho
-                //======================================================================
-                Grid_FFT<real_t> rho({ngrid, ngrid, ngrid}, {boxlen, boxlen, boxlen});
-
-                wnoise.FourierTransformForward();
-                rho.FourierTransformForward(false);
-                rho.assign_function_of_grids_kdep( [&]( auto k, auto wn ){
-                    return wn * the_cosmo_calc->get_amplitude_delta_bc(k.norm(),bDoLinearBCcorr);
-                }, wnoise );
-                rho.zero_DC_mode();
-                rho.FourierTransformBackward();
-
-                rho.apply_function_r( [&]( auto prho ){
-                    return (1.0 + C_species * prho) * Omega[this_species] * munit;
-                });
+                std::unique_ptr<particle::lattice_generator<Grid_FFT<real_t>>> particle_lattice_generator_ptr;
+
+                // if output plugin wants particles, then we need to store them, along with their IDs
+                if( the_output_plugin->writes_species_as( this_species, output_type::particles ) )
+                {
+                    // somewhat arbitrarily, start baryon particle IDs from 2**31 if we have 32bit and from 2**56 if we have 64 bits
+                    size_t IDoffset = (this_species == cosmo_species::baryon)? ((the_output_plugin->has_64bit_ids())? 1 : 1): 0 ;
+
+                    // allocate particle structure and generate particle IDs
+                    bool secondary_lattice = (this_species == cosmo_species::baryon &&
+                                            the_output_plugin->writes_species_as( this_species, output_type::particles )) ? true : false;
+
+                    particle_lattice_generator_ptr = 
+                    std::make_unique<particle::lattice_generator<Grid_FFT<real_t>>>( lattice_type, secondary_lattice, the_output_plugin->has_64bit_reals(), the_output_plugin->has_64bit_ids(), 
+                        bDoBaryons, IDoffset, tmp, the_config );
+                }
+
+                // set the perturbed particle masses if we have baryons
+                if( bDoBaryons && (the_output_plugin->writes_species_as( this_species, output_type::particles )
+                    || the_output_plugin->writes_species_as( this_species, output_type::field_lagrangian )) ) 
+                {
+                    bool secondary_lattice = (this_species == cosmo_species::baryon &&
+                                            the_output_plugin->writes_species_as( this_species, output_type::particles )) ? true : false;
+
+                    const real_t munit = the_output_plugin->mass_unit();
+
+                    //======================================================================
+                    // initialise rho
+                    //======================================================================
+                    Grid_FFT<real_t> rho({ngrid, ngrid, ngrid}, {boxlen, boxlen, boxlen});
+
+                    white_noise().FourierTransformForward();
+                    rho.FourierTransformForward(false);
+                    rho.assign_function_of_grids_kdep( [&]( auto k, auto wn ){
+                        return wn * the_cosmo_calc->get_amplitude_delta_bc(k.norm(),bDoLinearBCcorr);
+                    }, white_noise() );
+                    rho.zero_DC_mode();
+                    rho.FourierTransformBackward();
+
+                    rho.apply_function_r( [&]( auto prho ){
+                        return (1.0 + C_species * prho) * Omega[this_species] * munit;
+                    });
                 
-                if( the_output_plugin->write_species_as( this_species ) == output_type::particles ){
-                    particle_lattice_generator_ptr->set_masses( lattice_type, secondary_lattice, 1.0, the_output_plugin->has_64bit_reals(), rho, the_config );
-                }else if( the_output_plugin->write_species_as( this_species ) == output_type::field_lagrangian ){
-                    the_output_plugin->write_grid_data( rho, this_species, fluid_component::mass );
+                    if( the_output_plugin->writes_species_as( this_species, output_type::particles ) ){
+                        particle_lattice_generator_ptr->set_masses( lattice_type, secondary_lattice, 1.0, the_output_plugin->has_64bit_reals(), rho, the_config );
+                    }
+                    if( the_output_plugin->writes_species_as( this_species, output_type::field_lagrangian ) ){
+                        the_output_plugin->write_grid_data_as( rho, this_species, fluid_component::mass, output_type::field_lagrangian );
+                    }
                 }
-            }
 
-            //if( the_output_plugin->write_species_as( cosmo_species::dm ) == output_type::field_eulerian ){
-            if( the_output_plugin->write_species_as(this_species) == output_type::field_eulerian )
-            {
-                //======================================================================
-                // use QPT to get density and velocity fields
-                //======================================================================
-                Grid_FFT<ccomplex_t> psi({ngrid, ngrid, ngrid}, {boxlen, boxlen, boxlen});
-                Grid_FFT<real_t> rho({ngrid, ngrid, ngrid}, {boxlen, boxlen, boxlen});
-
-                //======================================================================
-                // initialise rho
-                //======================================================================
-                wnoise.FourierTransformForward();
-                rho.FourierTransformForward(false);
-                rho.assign_function_of_grids_kdep( [&]( auto k, auto wn ){
-                    return wn * the_cosmo_calc->get_amplitude_delta_bc(k.norm(), false);
-                }, wnoise );
-                rho.zero_DC_mode();
-                rho.FourierTransformBackward();
+                //if( the_output_plugin->write_species_as( cosmo_species::dm ) == output_type::field_eulerian ){
+                if( the_output_plugin->writes_species_as( this_species, output_type::field_eulerian ) )
+                {
+                    //======================================================================
+                    // use QPT to get density and velocity fields
+                    //======================================================================
+                    Grid_FFT<ccomplex_t> psi({ngrid, ngrid, ngrid}, {boxlen, boxlen, boxlen});
+                    Grid_FFT<real_t> rho({ngrid, ngrid, ngrid}, {boxlen, boxlen, boxlen});
+
+                    //======================================================================
+                    // initialise rho
+                    //======================================================================
+                    white_noise().FourierTransformForward();
+                    rho.FourierTransformForward(false);
+                    rho.assign_function_of_grids_kdep( [&]( auto k, auto wn ){
+                        return wn * the_cosmo_calc->get_amplitude_delta_bc(k.norm(), false);
+                    }, white_noise() );
+                    rho.zero_DC_mode();
+                    rho.FourierTransformBackward();
                 
-                rho.apply_function_r( [&]( auto prho ){
-                    return std::sqrt( 1.0 + C_species * prho );
-                });
-
-                //======================================================================
-                // initialise psi = exp(i Phi(1)/hbar)
-                //======================================================================
-                phi.FourierTransformBackward();
-
-                real_t maxdphi = -1.0;
-
-                #pragma omp parallel for reduction(max:maxdphi)
-                for( size_t i=0; i<phi.size(0)-1; ++i ){
-                    size_t ir = (i+1)%phi.size(0);
-                    for( size_t j=0; j<phi.size(1); ++j ){
-                        size_t jr = (j+1)%phi.size(1);    
-                        for( size_t k=0; k<phi.size(2); ++k ){
-                            size_t kr = (k+1)%phi.size(2);
-                            auto phic = phi.relem(i,j,k);
-
-                            auto dphixr = std::fabs(phi.relem(ir,j,k) - phic);
-                            auto dphiyr = std::fabs(phi.relem(i,jr,k) - phic);
-                            auto dphizr = std::fabs(phi.relem(i,j,kr) - phic);
+                    rho.apply_function_r( [&]( auto prho ){
+                        return std::sqrt( 1.0 + C_species * prho );
+                    });
+
+                    //======================================================================
+                    // initialise psi = exp(i Phi(1)/hbar)
+                    //======================================================================
+                    phi.FourierTransformBackward();
+
+                    real_t maxdphi = -1.0;
+
+                    #pragma omp parallel for reduction(max:maxdphi)
+                    for( size_t i=0; i<phi.size(0)-1; ++i ){
+                        size_t ir = (i+1)%phi.size(0);
+                        for( size_t j=0; j<phi.size(1); ++j ){
+                            size_t jr = (j+1)%phi.size(1);    
+                            for( size_t k=0; k<phi.size(2); ++k ){
+                                size_t kr = (k+1)%phi.size(2);
+                                auto phic = phi.relem(i,j,k);
+
+                                auto dphixr = std::fabs(phi.relem(ir,j,k) - phic);
+                                auto dphiyr = std::fabs(phi.relem(i,jr,k) - phic);
+                                auto dphizr = std::fabs(phi.relem(i,j,kr) - phic);
                             
-                            maxdphi = std::max(maxdphi,std::max(dphixr,std::max(dphiyr,dphizr)));
+                                maxdphi = std::max(maxdphi,std::max(dphixr,std::max(dphiyr,dphizr)));
+                            }
                         }
                     }
-                }
-                #if defined(USE_MPI)
-                    real_t local_maxdphi = maxdphi;
-                    MPI_Allreduce( &local_maxdphi, &maxdphi, 1, MPI::get_datatype<real_t>(), MPI_MAX, MPI_COMM_WORLD );
-                #endif
-                const real_t hbar_safefac = 1.01;
-                const real_t hbar = maxdphi / M_PI / Dplus0 * hbar_safefac;
-                music::ilog << "Semiclassical PT : hbar = " << hbar << " (limited by initial potential, safety=" << hbar_safefac << ")." << std::endl;
+                    #if defined(USE_MPI)
+                        real_t local_maxdphi = maxdphi;
+                        MPI_Allreduce( &local_maxdphi, &maxdphi, 1, MPI::get_datatype<real_t>(), MPI_MAX, MPI::get_comm() );
+                    #endif
+                    const real_t hbar_safefac = 1.01;
+                    const real_t hbar = maxdphi / M_PI / Dplus0 * hbar_safefac;
+                    music::ilog << "Semiclassical PT : hbar = " << hbar << " (limited by initial potential, safety=" << hbar_safefac << ")." << std::endl;
                 
-                if( LPTorder == 1 ){
-                    psi.assign_function_of_grids_r([hbar,Dplus0]( real_t pphi, real_t prho ){
-                        return prho * std::exp(ccomplex_t(0.0,1.0/hbar) * (pphi / Dplus0)); // divide by Dplus since phi already contains it
-                    }, phi, rho );
-                }else if( LPTorder >= 2 ){
-                    phi2.FourierTransformBackward();
-                    // we don't have a 1/2 in the Veff term because pre-factor is already 3/7
-                    psi.assign_function_of_grids_r([hbar,Dplus0]( real_t pphi, real_t pphi2, real_t prho ){
-                        return prho * std::exp(ccomplex_t(0.0,1.0/hbar) * (pphi + pphi2) / Dplus0);
-                    }, phi, phi2, rho );
-                }
+                    if( LPTorder == 1 ){
+                        psi.assign_function_of_grids_r([hbar,Dplus0]( real_t pphi, real_t prho ){
+                            return prho * std::exp(ccomplex_t(0.0,1.0/hbar) * (pphi / Dplus0)); // divide by Dplus since phi already contains it
+                        }, phi, rho );
+                    }else if( LPTorder >= 2 ){
+                        phi2.FourierTransformBackward();
+                        // we don't have a 1/2 in the Veff term because pre-factor is already 3/7
+                        psi.assign_function_of_grids_r([hbar,Dplus0]( real_t pphi, real_t pphi2, real_t prho ){
+                            return prho * std::exp(ccomplex_t(0.0,1.0/hbar) * (pphi + pphi2) / Dplus0);
+                        }, phi, phi2, rho );
+                    }
 
-                //======================================================================
-                // evolve wave-function (one drift step) psi = psi *exp(-i hbar *k^2 dt / 2)
-                //======================================================================
-                psi.FourierTransformForward();
-                psi.apply_function_k_dep([hbar,Dplus0]( auto epsi, auto k ){
-                    auto k2 = k.norm_squared();
-                    return epsi * std::exp( - ccomplex_t(0.0,0.5)*hbar* k2 * Dplus0);
-                });
-                psi.FourierTransformBackward();
-
-                if( LPTorder >= 2 ){
-                    psi.assign_function_of_grids_r([&](auto ppsi, auto pphi2) {
-                        return ppsi * std::exp(ccomplex_t(0.0,1.0/hbar) * (pphi2) / Dplus0);
-                    }, psi, phi2);
-                }
+                    //======================================================================
+                    // evolve wave-function (one drift step) psi = psi *exp(-i hbar *k^2 dt / 2)
+                    //======================================================================
+                    psi.FourierTransformForward();
+                    psi.apply_function_k_dep([hbar,Dplus0]( auto epsi, auto k ){
+                        auto k2 = k.norm_squared();
+                        return epsi * std::exp( - ccomplex_t(0.0,0.5)*hbar* k2 * Dplus0);
+                    });
+                    psi.FourierTransformBackward();
+
+                    if( LPTorder >= 2 ){
+                        psi.assign_function_of_grids_r([&](auto ppsi, auto pphi2) {
+                            return ppsi * std::exp(ccomplex_t(0.0,1.0/hbar) * (pphi2) / Dplus0);
+                        }, psi, phi2);
+                    }
 
-                //======================================================================
-                // compute rho
-                //======================================================================
-                rho.assign_function_of_grids_r([&]( auto p ){
-                    auto pp = std::real(p)*std::real(p) + std::imag(p)*std::imag(p) - 1.0;
-                    return pp;
-                }, psi);
-
-                the_output_plugin->write_grid_data( rho, this_species, fluid_component::density );
-                rho.Write_PowerSpectrum(the_config.get_path_relative_to_config("input_powerspec_sampled_evolved_semiclassical.txt"));
-                rho.FourierTransformBackward();
+                    //======================================================================
+                    // compute rho
+                    //======================================================================
+                    rho.assign_function_of_grids_r([&]( auto p ){
+                        auto pp = std::real(p)*std::real(p) + std::imag(p)*std::imag(p) - 1.0;
+                        return pp;
+                    }, psi);
+
+                    the_output_plugin->write_grid_data_as( rho, this_species, fluid_component::density, output_type::field_eulerian );
+                    rho.Write_PowerSpectrum(the_config.get_path_relative_to_config(suffixed_filename("input_powerspec_sampled_evolved_semiclassical.txt", output_suffix(iz, imember))));
+                    rho.FourierTransformBackward();
                 
-                // //======================================================================
-                // // compute  v
-                // //======================================================================
-                // Grid_FFT<ccomplex_t> grad_psi({ngrid, ngrid, ngrid}, {boxlen, boxlen, boxlen});
-                // const real_t vunit = Dplus0 * vfac / boxlen * the_output_plugin->velocity_unit();
-                // for( int idim=0; idim<3; ++idim )
-                // {
-                //     grad_psi.FourierTransformBackward(false);
-                //     grad_psi.copy_from(psi);
-                //     grad_psi.FourierTransformForward();
-                //     grad_psi.apply_function_k_dep([&](auto x, auto k) {
-                //         return x * ccomplex_t(0.0,k[idim]);
-                //     });
-                //     grad_psi.FourierTransformBackward();
+                    // //======================================================================
+                    // // compute  v
+                    // //======================================================================
+                    // Grid_FFT<ccomplex_t> grad_psi({ngrid, ngrid, ngrid}, {boxlen, boxlen, boxlen});
+                    // const real_t vunit = Dplus0 * vfac / boxlen * the_output_plugin->velocity_unit();
+                    // for( int idim=0; idim<3; ++idim )
+                    // {
+                    //     grad_psi.FourierTransformBackward(false);
+                    //     grad_psi.copy_from(psi);
+                    //     grad_psi.FourierTransformForward();
+                    //     grad_psi.apply_function_k_dep([&](auto x, auto k) {
+                    //         return x * ccomplex_t(0.0,k[idim]);
+                    //     });
+                    //     grad_psi.FourierTransformBackward();
                     
-                //     tmp.FourierTransformBackward(false);
-                //     tmp.assign_function_of_grids_r([&](auto ppsi, auto pgrad_psi, auto prho) {
-                //             return vunit * std::real((std::conj(ppsi) * pgrad_psi - ppsi * std::conj(pgrad_psi)) / ccomplex_t(0.0, 2.0 / hbar)/real_t(1.0+prho));
-                //         }, psi, grad_psi, rho);
-
-                //     fluid_component fc = (idim==0)? fluid_component::vx : ((idim==1)? fluid_component::vy : fluid_component::vz );
-                //     the_output_plugin->write_grid_data( tmp, this_species, fc );
-                // }
-
-                //======================================================================
-                // write phi, phi2, phi3
-                //======================================================================
-                the_output_plugin->write_grid_data( phi, this_species, fluid_component::phi );
-                if( LPTorder > 1 ){
-                    the_output_plugin->write_grid_data( phi2, this_species, fluid_component::phi2 );
-                }
-                if( LPTorder > 2 ){
-                    phi3.FourierTransformBackward();
-                    the_output_plugin->write_grid_data( phi3, this_species, fluid_component::phi3 );
-                    for( int idim=0; idim<3; ++idim ){
-                        fluid_component fc = (idim==0)? fluid_component::A1 : ((idim==1)? fluid_component::A2 : fluid_component::A3 );
-                        A3[idim]->FourierTransformBackward();
-                        the_output_plugin->write_grid_data( *A3[idim], this_species, fc );
+                    //     tmp.FourierTransformBackward(false);
+                    //     tmp.assign_function_of_grids_r([&](auto ppsi, auto pgrad_psi, auto prho) {
+                    //             return vunit * std::real((std::conj(ppsi) * pgrad_psi - ppsi * std::conj(pgrad_psi)) / ccomplex_t(0.0, 2.0 / hbar)/real_t(1.0+prho));
+                    //         }, psi, grad_psi, rho);
+
+                    //     fluid_component fc = (idim==0)? fluid_component::vx : ((idim==1)? fluid_component::vy : fluid_component::vz );
+                    //     the_output_plugin->write_grid_data( tmp, this_species, fc );
+                    // }
+
+                    //======================================================================
+                    // write phi, phi2, phi3
+                    //======================================================================
+                    the_output_plugin->write_grid_data_as( phi, this_species, fluid_component::phi, output_type::field_eulerian );
+                    if( LPTorder > 1 ){
+                        the_output_plugin->write_grid_data_as( phi2, this_species, fluid_component::phi2, output_type::field_eulerian );
+                    }
+                    if( LPTorder > 2 ){
+                        phi3.FourierTransformBackward();
+                        the_output_plugin->write_grid_data_as( phi3, this_species, fluid_component::phi3, output_type::field_eulerian );
+                        expand_A3();
+                        for( int idim=0; idim<3; ++idim ){
+                            fluid_component fc = (idim==0)? fluid_component::A1 : ((idim==1)? fluid_component::A2 : fluid_component::A3 );
+                            A3[idim]->FourierTransformBackward();
+                            the_output_plugin->write_grid_data_as( *A3[idim], this_species, fc, output_type::field_eulerian );
+                        }
                     }
-                }
 
-            }
+                }
 
-            if( the_output_plugin->write_species_as( this_species ) == output_type::particles 
-             || the_output_plugin->write_species_as( this_species ) == output_type::field_lagrangian )
-            {
-                //===================================================================================
-                // we store displacements and velocities here if we compute them
-                //===================================================================================
+                if( the_output_plugin->writes_species_as( this_species, output_type::particles ) 
+                 || the_output_plugin->writes_species_as( this_species, output_type::field_lagrangian ) )
+                {
+                    //===================================================================================
+                    // we store displacements and velocities here if we compute them
+                    //===================================================================================
                 
 
-                bool shifted_lattice = (this_species == cosmo_species::baryon &&
-                                        the_output_plugin->write_species_as(this_species) == output_type::particles) ? true : false;
+                    bool shifted_lattice = (this_species == cosmo_species::baryon &&
+                                            the_output_plugin->writes_species_as( this_species, output_type::particles )) ? true : false;
 
-                
-                grid_interpolate<1,Grid_FFT<real_t>> interp( tmp );
 
-                phi.FourierTransformForward();
-                if( LPTorder > 1 ){
-                    phi2.FourierTransformForward();
-                }
-                if( LPTorder > 2 ){
-                    phi3.FourierTransformForward();
-                    A3[0]->FourierTransformForward();
-                    A3[1]->FourierTransformForward();
-                    A3[2]->FourierTransformForward();
-                }
-                wnoise.FourierTransformForward();
+                    phi.FourierTransformForward();
+                    if( LPTorder > 1 ){
+                        phi2.FourierTransformForward();
+                    }
+                    if( LPTorder > 2 ){
+                        phi3.FourierTransformForward();
+                        A3[0]->FourierTransformForward();
+                        A3[1]->FourierTransformForward();
+                        if( !bA3transverse ){
+                            A3[2]->FourierTransformForward();
+                        }
+                    }
+                    // the white noise is only read again by the baryon-CDM relative velocity correction
+                    Grid_FFT<real_t> &wnoise_vbc = (bDoBaryons && bDoLinearBCcorr) ? white_noise() : wnoise;
+                    wnoise_vbc.FourierTransformForward();
+
+                    //... runtime options of the k-space kernels, resolved once before the mode loops
+                    const bool bglass_compensation = (the_output_plugin->writes_species_as( this_species, output_type::particles ) && lattice_type == particle::lattice_glass);
+                    const lpt_kernels::potentials_t potentials{phi, phi2, phi3, A3};
+                    //... the compensation kernel is tabulated per axis, so the mode loops only multiply table entries
+                    lpt_kernels::separable_kernel_t compensation;
+                    if( bglass_compensation ){
+                        compensation = lpt_kernels::separable_kernel_t( tmp, [&]( int idim, real_t k ){
+                            return particle_lattice_generator_ptr->compensation_kernel_1d( idim, k );
+                        });
+                    }
+                    auto theta_bc = [&]( real_t knorm ) -> real_t {
+                        return vfac1 * C_species * the_cosmo_calc->get_amplitude_theta_bc( knorm, bDoLinearBCcorr );
+                    };
             
-                // write out positions
-                for( int idim=0; idim<3; ++idim ){
-                    // cyclic rotations of indices
-                    const int idimp = (idim+1)%3, idimpp = (idim+2)%3;
-                    const real_t lunit = the_output_plugin->position_unit();
-                    
-                    tmp.FourierTransformForward(false);
-
-                    // combine the various LPT potentials into one and take gradient
-                    #pragma omp parallel for
-                    for (size_t i = 0; i < phi.size(0); ++i) {
-                        for (size_t j = 0; j < phi.size(1); ++j) {
-                            for (size_t k = 0; k < phi.size(2); ++k) {
-                                size_t idx = phi.get_idx(i,j,k);
-                                auto phitot = phi.kelem(idx);
-
-                                if( LPTorder > 1 ){
-                                    phitot += phi2.kelem(idx);
-                                }
+                    //... the glass interpolation compensation only applies to particle data, if Lagrangian fields are
+                    //... written as well (several output formats), they get a second, uncompensated pass
+                    const bool bto_particles = the_output_plugin->writes_species_as( this_species, output_type::particles );
+                    const bool bto_fields = the_output_plugin->writes_species_as( this_species, output_type::field_lagrangian );
+                    const int npasses = (bglass_compensation && bto_fields)? 2 : 1;
 
-                                if( LPTorder > 2 ){
-                                    phitot += phi3.kelem(idx);
-                                }
-
-                                tmp.kelem(idx) = lg.gradient(idim,tmp.get_k3(i,j,k)) * phitot;
-
-                                if( LPTorder > 2 ){
-                                    tmp.kelem(idx) += lg.gradient(idimp,tmp.get_k3(i,j,k)) * A3[idimpp]->kelem(idx) - lg.gradient(idimpp,tmp.get_k3(i,j,k)) * A3[idimp]->kelem(idx);
-                                }
-
-                                if( the_output_plugin->write_species_as( this_species ) == output_type::particles && lattice_type == particle::lattice_glass){
-                                    tmp.kelem(idx) *= interp.compensation_kernel( tmp.get_k<real_t>(i,j,k) ) ;
-                                }
+                    // write out positions
+                    for( int idim=0; idim<3; ++idim ){
+                        const real_t lunit = the_output_plugin->position_unit();
 
-                                // divide by Lbox, because displacement is in box units for output plugin
-                                tmp.kelem(idx) *=  lunit / boxlen;
+                        for( int ipass=0; ipass<npasses; ++ipass ){
+                            const bool bcompensate = bglass_compensation && ipass == 0;
+                    
+                            tmp.FourierTransformForward(false);
+
+                            // combine the various LPT potentials into one and take gradient, divide by Lbox, because displacement is in box units for output plugin
+                            lpt_kernels::dispatch(LPTorder, bcompensate, false, bA3transverse, [&](auto order, auto bglass, auto, auto btransverse) {
+                                lpt_kernels::displacement<decltype(order)::value, decltype(bglass)::value, decltype(btransverse)::value>(tmp, idim, potentials, lg, compensation, lunit / boxlen);
+                            });
+                            tmp.zero_DC_mode();
+                            tmp.FourierTransformBackward();
+
+                            // if we write particle data, store particle data in particle structure
+                            if( bto_particles && ipass == 0 )
+                            {
+                                particle_lattice_generator_ptr->set_positions( lattice_type, shifted_lattice, idim, lunit, the_output_plugin->has_64bit_reals(), tmp, the_config );
+                            } 
+                            // and/or write out the grid data directly to the output plugin
+                            if( bto_fields && !bcompensate )
+                            {
+                                fluid_component fc = (idim==0)? fluid_component::dx : ((idim==1)? fluid_component::dy : fluid_component::dz );
+                                the_output_plugin->write_grid_data_as( tmp, this_species, fc, output_type::field_lagrangian );
                             }
                         }
                     }
-                    tmp.zero_DC_mode();
-                    tmp.FourierTransformBackward();
 
-                    // if we write particle data, store particle data in particle structure
-                    if( the_output_plugin->write_species_as( this_species ) == output_type::particles )
-                    {
-                        particle_lattice_generator_ptr->set_positions( lattice_type, shifted_lattice, idim, lunit, the_output_plugin->has_64bit_reals(), tmp, the_config );
-                    } 
-                    // otherwise write out the grid data directly to the output plugin
-                    // else if( the_output_plugin->write_species_as( cosmo_species::dm ) == output_type::field_lagrangian )
-                    else if( the_output_plugin->write_species_as( this_species ) == output_type::field_lagrangian )
-                    {
-                        fluid_component fc = (idim==0)? fluid_component::dx : ((idim==1)? fluid_component::dy : fluid_component::dz );
-                        the_output_plugin->write_grid_data( tmp, this_species, fc );
-                    }
-                }
+                    // write out velocities
+                    for( int idim=0; idim<3; ++idim ){
+                        const real_t vunit = the_output_plugin->velocity_unit();
+
+                        // modify velocities with anisotropic expansion factor**2, divide by Lbox, because velocity is in box units for output plugin
+                        const real_t vfac_tot = (bAddExternalTides ? std::pow(lss_aniso_alpha[idim], 2.0) : 1.0) * vunit / boxlen;
 
-                // write out velocities
-                for( int idim=0; idim<3; ++idim ){
-                    // cyclic rotations of indices
-                    int idimp = (idim+1)%3, idimpp = (idim+2)%3;
-                    const real_t vunit = the_output_plugin->velocity_unit();
+                        for( int ipass=0; ipass<npasses; ++ipass ){
+                            const bool bcompensate = bglass_compensation && ipass == 0;
                     
-                    tmp.FourierTransformForward(false);
-
-                    #pragma omp parallel for
-                    for (size_t i = 0; i < phi.size(0); ++i) {
-                        for (size_t j = 0; j < phi.size(1); ++j) {
-                            for (size_t k = 0; k < phi.size(2); ++k) {
-                                size_t idx = phi.get_idx(i,j,k);
-                                
-                                auto phitot_v = vfac1 * phi.kelem(idx);
-                                
-                                if( LPTorder > 1 ){
-                                    phitot_v += vfac2 * phi2.kelem(idx);
-                                }
-
-                                if( LPTorder > 2 ){
-                                    phitot_v += vfac3 * phi3.kelem(idx);
-                                }
-                                
-                                tmp.kelem(idx) = lg.gradient(idim,tmp.get_k3(i,j,k)) * phitot_v;
-                                
-                                if( LPTorder > 2 ){
-                                    tmp.kelem(idx) += vfac3 * (lg.gradient(idimp,tmp.get_k3(i,j,k)) * A3[idimpp]->kelem(idx) - lg.gradient(idimpp,tmp.get_k3(i,j,k)) * A3[idimp]->kelem(idx));
-                                }
-
-                                // if multi-species, then add vbc component backwards
-                                if( bDoBaryons & bDoLinearBCcorr ){
-                                    real_t knorm = wnoise.get_k<real_t>(i,j,k).norm();
-                                    tmp.kelem(idx) -= vfac1 * C_species * the_cosmo_calc->get_amplitude_theta_bc(knorm, bDoLinearBCcorr) * wnoise.kelem(i,j,k) * lg.gradient(idim,tmp.get_k3(i,j,k)) / (knorm*knorm);
-                                }
-
-                                // correct with interpolation kernel if we used interpolation to read out the positions (for glasses)
-                                if( the_output_plugin->write_species_as( this_species ) == output_type::particles && lattice_type == particle::lattice_glass){
-                                    tmp.kelem(idx) *= interp.compensation_kernel( tmp.get_k<real_t>(i,j,k) );
-                                }
-
-                                // correct velocity with PLT mode growth rate
-                                tmp.kelem(idx) *= lg.vfac_corr(tmp.get_k3(i,j,k));
-
-                                if( bAddExternalTides ){
-                                    // modify velocities with anisotropic expansion factor**2
-                                    tmp.kelem(idx) *= std::pow(lss_aniso_alpha[idim],2.0);
-                                }
-
-                                // divide by Lbox, because displacement is in box units for output plugin
-                                tmp.kelem(idx) *= vunit / boxlen;
+                            tmp.FourierTransformForward(false);
+
+                            lpt_kernels::dispatch(LPTorder, bcompensate, bDoBaryons & bDoLinearBCcorr, bA3transverse, [&](auto order, auto bglass, auto bbaryons, auto btransverse) {
+                                lpt_kernels::velocity<decltype(order)::value, decltype(bglass)::value, decltype(bbaryons)::value, decltype(btransverse)::value>(
+                                    tmp, idim, potentials, {vfac1, vfac2, vfac3}, wnoise_vbc, theta_bc, lg, compensation, vfac_tot);
+                            });
+                            tmp.zero_DC_mode();
+                            tmp.FourierTransformBackward();
+
+                            // if we write particle data, store particle data in particle structure
+                            if( bto_particles && ipass == 0 )
+                            {
+                                particle_lattice_generator_ptr->set_velocities( lattice_type, shifted_lattice, idim, the_output_plugin->has_64bit_reals(), tmp, the_config );
+                            }
+                            // and/or write out the grid data directly to the output plugin
+                            if( bto_fields && !bcompensate )
+                            {
+                                fluid_component fc = (idim==0)? fluid_component::vx : ((idim==1)? fluid_component::vy : fluid_component::vz );
+                                the_output_plugin->write_grid_data_as( tmp, this_species, fc, output_type::field_lagrangian );
                             }
                         }
                     }
-                    tmp.zero_DC_mode();
-                    tmp.FourierTransformBackward();
 
-                    // if we write particle data, store particle data in particle structure
-                    if( the_output_plugin->write_species_as( this_species ) == output_type::particles )
+                    if( the_output_plugin->writes_species_as( this_species, output_type::particles ) )
                     {
-                        particle_lattice_generator_ptr->set_velocities( lattice_type, shifted_lattice, idim, the_output_plugin->has_64bit_reals(), tmp, the_config );
+                        the_output_plugin->write_particle_data( particle_lattice_generator_ptr->get_particles(), this_species, Omega[this_species] );
                     }
-                    // otherwise write out the grid data directly to the output plugin
-                    else if( the_output_plugin->write_species_as( this_species ) == output_type::field_lagrangian )
+                
+                    if( the_output_plugin->writes_species_as( this_species, output_type::field_lagrangian ) )
                     {
-                        fluid_component fc = (idim==0)? fluid_component::vx : ((idim==1)? fluid_component::vy : fluid_component::vz );
-                        the_output_plugin->write_grid_data( tmp, this_species, fc );
+                        // use density simply from 1st order SPT
+                        phi.FourierTransformForward();
+                        tmp.FourierTransformForward(false);
+                        tmp.assign_function_of_grids_kdep( []( auto kvec, auto pphi ){
+                            return kvec.norm_squared() *  pphi;
+                        }, phi);
+                        tmp.Write_PowerSpectrum(the_config.get_path_relative_to_config(suffixed_filename("input_powerspec_sampled_SPT.txt", output_suffix(iz, imember))));
+                        tmp.FourierTransformBackward();
+                        the_output_plugin->write_grid_data_as( tmp, this_species, fluid_component::density, output_type::field_lagrangian );
                     }
                 }
 
-                if( the_output_plugin->write_species_as( this_species ) == output_type::particles )
-                {
-                    the_output_plugin->write_particle_data( particle_lattice_generator_ptr->get_particles(), this_species, Omega[this_species] );
-                }
-                
-                if( the_output_plugin->write_species_as( this_species ) == output_type::field_lagrangian )
-                {
-                    // use density simply from 1st order SPT
-                    phi.FourierTransformForward();
-                    tmp.FourierTransformForward(false);
-                    tmp.assign_function_of_grids_kdep( []( auto kvec, auto pphi ){
-                        return kvec.norm_squared() *  pphi;
-                    }, phi);
-                    tmp.Write_PowerSpectrum("input_powerspec_sampled_SPT.txt");
-                    tmp.FourierTransformBackward();
-                    the_output_plugin->write_grid_data( tmp, this_species, fluid_component::density );
-                }
             }
-
-        }
         
-        music::ilog << "-------------------------------------------------------------------------------" << std::endl;
+            music::ilog << "-------------------------------------------------------------------------------" << std::endl;
         
+        }
+    }
+    return 0;
+}
+
+
+/**
+ * @brief Loops over the cosmologies of a sweep, all with the white noise of the first one
+ * 
+ * The white noise is generated and transformed once and kept in k-space, and the convolver and gradient operator
+ * are kept as well; for each further cosmology only a new cosmology calculator (with its transfer function tables)
+ * and output plugin are created, and the LPT potentials are computed again from the kept noise.
+ * 
+ * @param the_config reference to the config_file object
+ * @return int 0 if successful
+ */
+int run_sweep( config_file& the_config )
+{
+    lpt_setup_t setup;
+
+    for( isweep = 0; isweep < sweep_cosmologies.size(); ++isweep )
+    {
+        music::ilog << "-------------------------------------------------------------------------------" << std::endl;
+        music::ilog << ">>> Cosmology " << isweep + 1 << " of " << sweep_cosmologies.size() << ":";
+        for( const auto& kv : sweep_cosmologies[isweep].params ) music::ilog << " " << kv.first << "=" << kv.second;
+        music::ilog << " <<<" << std::endl;
+
+        if( isweep > 0 ){
+            // the previous output is finalised when its plugin is destroyed
+            the_output_plugin.reset();
+            the_cosmo_calc.reset();
+
+            configure_sweep_cosmology( the_config, isweep );
+            configure_output( the_config, 0, 0 );
+
+            the_cosmo_calc              = std::make_unique<cosmology::calculator>(the_config);
+            the_output_plugin           = std::move(select_output_plugin(the_config, the_cosmo_calc));
+        }
+
+        run_realisation( the_config, setup );
     }
     return 0;
 }
 
+/**
+ * @brief Main driver routine for IC generation, loops over the realisations of an ensemble
+ * 
+ * The cosmology calculator (transfer functions, growth tables, normalisation), the convolver with its FFTW plans
+ * and the gradient operator with the PLT eigenmodes and operator tables are set up once; for each further seed 
+ * only the RNG and output plugins are created again. Grid memory is reused through the grid memory pool.
+ * 
+ * @param the_config reference to the config_file object
+ * @return int 0 if successful
+ */
+int run( config_file& the_config )
+{
+    if( bSweep )
+        return run_sweep( the_config );
+
+    lpt_setup_t setup;
+
+    if( !bEnsemble )
+        return run_realisation( the_config, setup );
+
+    for( iensemble = 0; iensemble < ensemble_seeds.size(); ++iensemble )
+    {
+        music::ilog << "-------------------------------------------------------------------------------" << std::endl;
+        music::ilog << ">>> Realisation " << iensemble + 1 << " of " << ensemble_seeds.size() << ", seed " << ensemble_seeds[iensemble] << " <<<" << std::endl;
+
+        if( iensemble > 0 ){
+            // the previous output is finalised when its plugin is destroyed
+            the_output_plugin.reset();
+            the_random_number_generator.reset();
+
+            the_config.insert_value("random", "seed", std::to_string(ensemble_seeds[iensemble]));
+            configure_output( the_config, 0, 0 );
+            the_cosmo_calc->set_starting_scale_factor( 1.0/(1.0+zstart_list[0]) );
+
+            the_random_number_generator = std::move(select_RNG_plugin(the_config));
+            the_output_plugin           = std::move(select_output_plugin(the_config, the_cosmo_calc));
+        }
+
+        run_realisation( the_config, setup );
+    }
+    return 0;
+}
 
 } // end namespace ic_generator
 
@@ -27,6 +27,8 @@
 #endif
 
 #include <general.hh>
+#include <omp_loops.hh>
+#include <numa_memory.hh>
 #include <ic_generator.hh>
 #include <cosmology_parameters.hh>
 #include <particle_plt.hh>
@@ -37,9 +39,12 @@ namespace CONFIG{
 int  MPI_thread_support = -1;
 int  MPI_task_rank = 0;
 int  MPI_task_size = 1;
+int  MPI_group_index = 0;
+int  MPI_num_groups = 1;
 bool MPI_ok = false;
 bool MPI_threads_ok = false;
 bool FFTW_threads_ok = false;
+int  FFT_overlap_batches = 0;
 int  num_threads = 1;
 }
 
@@ -173,6 +178,26 @@ int main( int argc, char** argv )
 #endif
 
     CONFIG::num_threads = the_config.get_value_safe<unsigned>("execution", "NumThreads",std::thread::hardware_concurrency());
+
+#if defined(USE_MPI)
+    CONFIG::FFT_overlap_batches = the_config.get_value_safe<int>("execution", "FFTOverlapBatches", 0);
+
+    //------------------------------------------------------------------------------
+    // split into groups of tasks that generate different realisations of an ensemble
+    //------------------------------------------------------------------------------
+    CONFIG::MPI_num_groups = std::max(1, std::min(the_config.get_value_safe<int>("execution", "EnsembleGroups", 1), CONFIG::MPI_task_size));
+    if( CONFIG::MPI_num_groups > 1 )
+    {
+        // contiguous blocks of ranks, so that a group stays on as few nodes as possible
+        CONFIG::MPI_group_index = int( (long long)(CONFIG::MPI_task_rank) * CONFIG::MPI_num_groups / CONFIG::MPI_task_size );
+        MPI_Comm group_comm;
+        MPI_Comm_split(MPI_COMM_WORLD, CONFIG::MPI_group_index, CONFIG::MPI_task_rank, &group_comm);
+        MPI::set_comm(group_comm);
+        music::ilog << "Split " << CONFIG::MPI_task_size << " tasks into " << CONFIG::MPI_num_groups << " ensemble groups" << std::endl;
+        MPI_Comm_rank(group_comm, &CONFIG::MPI_task_rank);
+        MPI_Comm_size(group_comm, &CONFIG::MPI_task_size);
+    }
+#endif
     
 #if defined(USE_FFTW_THREADS)
     if (CONFIG::FFTW_threads_ok)
@@ -187,6 +212,17 @@ int main( int argc, char** argv )
     omp_set_num_threads(CONFIG::num_threads);
 #endif
 
+    omp_loops::initialise(the_config.get_value_safe<std::string>("execution", "OMPSchedule", "static"),
+                          the_config.get_value_safe<int>("execution", "OMPChunkSize", 0),
+                          the_config.get_value_safe<bool>("execution", "OMPReportImbalance", false));
+
+    numa_memory::initialise(the_config.get_value_safe<std::string>("execution", "MemoryPlacement", "firsttouch"),
+                            the_config.get_value_safe<std::string>("execution", "HugePages", "none"),
+                            the_config.get_value_safe<bool>("execution", "ReportNUMAPlacement", false));
+
+    numa_memory::pool_initialise(the_config.get_value_safe<bool>("execution", "GridPool", true)
+                                     ? std::max(the_config.get_value_safe<int>("execution", "GridPoolMaxBlocks", 4), 0) : 0);
+
     std::feclearexcept(FE_ALL_EXCEPT);
 
     //------------------------------------------------------------------------------
@@ -219,7 +255,8 @@ int main( int argc, char** argv )
     
     // MPI related infos
 #if defined(USE_MPI)
-    music::ilog << std::setw(32) << std::left << "MPI is enabled" << " : " << "yes (" << CONFIG::MPI_task_size << " tasks)" << std::endl;
+    music::ilog << std::setw(32) << std::left << "MPI is enabled" << " : " << "yes (" << CONFIG::MPI_task_size << " tasks"
+                << ((CONFIG::MPI_num_groups > 1)? " / group)" : ")") << std::endl;
     music::dlog << std::setw(32) << std::left << "MPI version" << " : " << MPI::get_version() << std::endl;
 #else
     music::ilog << std::setw(32) << std::left << "MPI is enabled" << " : " << "no" << std::endl;
@@ -242,6 +279,13 @@ int main( int argc, char** argv )
 #else
 	music::ilog << "FFTW_ESTIMATE" << std::endl;
 #endif
+#if defined(USE_MPI)
+    music::ilog << std::setw(32) << std::left << "Distributed FFT" << " : ";
+    if( CONFIG::FFT_overlap_batches > 0 )
+        music::ilog << "in-house, " << CONFIG::FFT_overlap_batches << " overlapped batches" << std::endl;
+    else
+        music::ilog << "FFTW-MPI" << std::endl;
+#endif
 
     ///////////////////////////////////////////////////////////////////////
     // Initialise plug-ins
@@ -264,10 +308,14 @@ int main( int argc, char** argv )
     ic_generator::run( the_config );
     ///////////////////////////////////////////////////////////////////////
 
+    omp_loops::report_imbalance();
+    numa_memory::pool_report();
+
 
     ///////////////////////////////////////////////////////////////////////
     // call the destructor of plugins before tearing down MPI
     ic_generator::reset();
+    numa_memory::pool_trim();
     ///////////////////////////////////////////////////////////////////////
 
     music::ilog << "-------------------------------------------------------------------------------" << std::endl;
@@ -285,6 +333,12 @@ int main( int argc, char** argv )
 
 
 #if defined(USE_MPI)
+    if( CONFIG::MPI_num_groups > 1 )
+    {
+        MPI_Comm group_comm = MPI::get_comm();
+        MPI::set_comm(MPI_COMM_WORLD);
+        MPI_Comm_free(&group_comm);
+    }
     MPI_Barrier(MPI_COMM_WORLD);
     MPI_Finalize();
 #endif
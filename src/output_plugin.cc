@@ -16,6 +16,7 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "output_plugin.hh"
+#include "output_multi.hh"
 
 /**
  * @brief Get the output plugin map object
@@ -52,6 +53,7 @@ void print_output_plugins()
  * @brief Return a pointer to the desired output plugin as given in the config file
  * 
  * Implements the abstract factory pattern (https://en.wikipedia.org/wiki/Abstract_factory_pattern)
+ * A comma separated list of formats returns an output_multi dispatcher writing to all of them
  * 
  * @param cf reference to config_file object
  * @param pcc reference to cosmology::calculator object
@@ -61,6 +63,10 @@ std::unique_ptr<output_plugin> select_output_plugin( config_file& cf, std::uniqu
 {
 	std::string formatname = cf.get_value<std::string>( "output", "format" );
 	
+	// a list of formats is written by a dispatcher that creates one plug-in per format
+	if( formatname.find(',') != std::string::npos )
+		return std::make_unique<output_multi>( cf, pcc );
+
 	output_plugin_creator *the_output_plugin_creator = get_output_plugin_map()[ formatname ];
 	
 	if( !the_output_plugin_creator )
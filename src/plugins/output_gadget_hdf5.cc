@@ -75,7 +75,7 @@ public:
     num_files_ = 1;
 #ifdef USE_MPI
     // use as many output files as we have MPI tasks
-    MPI_Comm_size(MPI_COMM_WORLD, &num_files_);
+    MPI_Comm_size(MPI::get_comm(), &num_files_);
 #endif
     real_t astart = 1.0 / (1.0 + cf_.get_value<double>("setup", "zstart"));
     const double rhoc = 27.7519737; // in h^2 1e10 M_sol / Mpc^3
@@ -124,7 +124,7 @@ public:
     this_fname_ = fname_prefix;
 #ifdef USE_MPI
     int thisrank = 0;
-    MPI_Comm_rank(MPI_COMM_WORLD, &thisrank);
+    MPI_Comm_rank(MPI::get_comm(), &thisrank);
     if (num_files_ > 1)
       this_fname_ += "." + std::to_string(thisrank);
 #endif
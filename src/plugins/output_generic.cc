@@ -56,7 +56,7 @@ public:
 		}
 
 #if defined(USE_MPI)
-		MPI_Barrier( MPI_COMM_WORLD );
+		MPI_Barrier( MPI::get_comm() );
 #endif
 	}
 
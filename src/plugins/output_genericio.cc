@@ -128,7 +128,7 @@ public:
     }
 
     ~genericio_output_plugin() override {
-        gio::GenericIO writer(MPI_COMM_WORLD, fname_, gio::GenericIO::FileIO::FileIOMPI);
+        gio::GenericIO writer(MPI::get_comm(), fname_, gio::GenericIO::FileIO::FileIOMPI);
         writer.setPhysOrigin(0., -1);
         writer.setPhysScale(lunit_, -1);
         writer.setNumElems(xx.size());
@@ -151,7 +151,7 @@ public:
             writer.addVariable("yhe", yhe);
         }
         writer.write();
-        MPI_Barrier(MPI_COMM_WORLD);
+        MPI_Barrier(MPI::get_comm());
     }
 };
 
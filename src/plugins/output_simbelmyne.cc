@@ -191,14 +191,14 @@ void simbelmyne_output_plugin::write_grid_data(const Grid_FFT<real_t> &g, const
     }
 
     #if defined(USE_MPI)
-        MPI_Barrier( MPI_COMM_WORLD );
+        MPI_Barrier( MPI::get_comm() );
     #endif
 
     // Write the dataset
     g.Write_to_HDF5(file_name, field_name);
 
     #if defined(USE_MPI)
-        MPI_Barrier( MPI_COMM_WORLD );
+        MPI_Barrier( MPI::get_comm() );
     #endif
 
     if( CONFIG::MPI_task_rank == 0 )
@@ -88,8 +88,8 @@ public:
     time_ = astart;
 
 #ifdef USE_MPI
-    MPI_Comm_rank(MPI_COMM_WORLD, &this_rank_);
-    MPI_Comm_size(MPI_COMM_WORLD, &num_ranks_);
+    MPI_Comm_rank(MPI::get_comm(), &this_rank_);
+    MPI_Comm_size(MPI::get_comm(), &num_ranks_);
 #endif
 
     if (bdobaryons_) {
@@ -295,7 +295,7 @@ public:
     const size_t n_local = pc.get_local_num_particles();
     size_t offset = 0;
 #ifdef USE_MPI
-    MPI_Exscan(&n_local, &offset, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Exscan(&n_local, &offset, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, MPI::get_comm());
 #endif
 
     // now each node writes its own chunk in a round-robin fashion, appending at the end of the currently existing data 
@@ -303,7 +303,7 @@ public:
 
 #ifdef USE_MPI
       // wait until the initialisation or the previous rank in the loop is done
-      MPI_Barrier(MPI_COMM_WORLD);
+      MPI_Barrier(MPI::get_comm());
 #endif
 
       if (rank == this_rank_) {
@@ -362,7 +362,7 @@ public:
 
 #ifdef USE_MPI
     // end with a barrier to make sure everyone is done before the destructor does its job
-    MPI_Barrier(MPI_COMM_WORLD);
+    MPI_Barrier(MPI::get_comm());
 #endif
   }
 };
@@ -32,6 +32,7 @@ protected:
   bool disk_cached_;
   bool restart_;
   bool initialized_;
+  bool distributed_;
 
   std::vector<std::vector<real_t> *> mem_cache_;
 
@@ -44,6 +45,12 @@ protected:
   //! computes the white noise fields and keeps them either in memory or on disk
   void compute_random_numbers(void);
 
+  //! computes the white noise field directly into a distributed grid, each task only generates its slab
+  void compute_random_numbers_distributed(Grid_FFT<real_t> &g);
+
+  //! fills the local slab of g with the cubes of level ilevel, optionally subtracting the global mean
+  void fill_level_slab(Grid_FFT<real_t> &g, int ilevel, bool zeromean);
+
   //! adjusts averages
   //void correct_avg(int icoarse, int ifine);
 
@@ -63,7 +70,7 @@ protected:
   }
 
 public:
-  explicit RNG_music(config_file &cf) : RNG_plugin(cf), initialized_(false) 
+  explicit RNG_music(config_file &cf) : RNG_plugin(cf), initialized_(false), distributed_(false)
   {
     // we need to make sure that the chosen resolution is a power of 2 resolution
     size_t res = pcf_->get_value<size_t>("setup", "GridRes");
@@ -91,6 +98,11 @@ public:
 
   void Fill_Grid( Grid_FFT<real_t>& g ) 
   {
+    if( distributed_ && g.is_distributed() ){
+      compute_random_numbers_distributed( g );
+      return;
+    }
+
     // determine extent of grid to be filled (can be a slab with MPI)
     const size_t i0 = g.local_0_start_, j0{0}, k0{0};
     const size_t Ni = g.rsize(0), Nj = g.rsize(1), Nk = g.rsize(2);
@@ -100,15 +112,15 @@ public:
 
     // copy over
     #pragma omp parallel for
-    for( auto i = i0; i<Ni; ++i )
+    for( size_t ip = 0; ip<Ni; ++ip )
     {
-      size_t ip  = i-i0; // index in g
-      for( auto j = j0; j<Nj; ++j )
+      size_t i = ip+i0; // global index
+      for( size_t jp = 0; jp<Nj; ++jp )
       {
-        auto   jp = j-j0; // index in g
-        for( auto k = k0; k<Nk; ++k )
+        auto   j = jp+j0; // global index
+        for( size_t kp = 0; kp<Nk; ++kp )
         {
-          auto   kp = k-k0; // index in g
+          auto   k = kp+k0; // global index
           g.relem(ip,jp,kp) = (*randc_[levelmin_])(i,j,k);
         } 
       }  
@@ -132,7 +144,19 @@ public:
     //... determine seed/white noise file data to be applied
     parse_random_parameters();
 
-    if (!restart_)
+#if defined(USE_MPI)
+    //... with MPI, generation from seeds is deferred to Fill_Grid and done slab by slab, 
+    //... white noise files are still read in full on every task. grafic_sign is a convention
+    //... of the white noise files only, so it is honoured by the serial path that reads them
+    distributed_ = true;
+    for (int ilevel = std::min(levelmin_, levelmin_seed_); ilevel <= std::max(levelmin_, levelmin_seed_); ++ilevel)
+      distributed_ &= (rngfnames_[ilevel].size() == 0);
+    
+    if (distributed_)
+      music::ilog << "MUSIC1 RNG plugin: white noise will be generated in parallel on " << MPI::get_size() << " tasks" << std::endl;
+#endif
+
+    if (!restart_ && !distributed_)
     {
       //... compute the actual random numbers
       compute_random_numbers();
@@ -359,6 +383,160 @@ void RNG_music::compute_random_numbers(void)
 
 
 
+void RNG_music::fill_level_slab(Grid_FFT<real_t> &g, int ilevel, bool zeromean)
+{
+  const size_t i0 = g.local_0_start_, Ni = g.rsize(0), Nj = g.rsize(1), Nk = g.rsize(2);
+
+  rng slab(1 << ilevel, ran_cube_size_, rngseeds_[ilevel], i0, Ni);
+
+  g.FourierTransformBackward(false);
+
+  #pragma omp parallel for
+  for (size_t i = 0; i < Ni; ++i)
+    for (size_t j = 0; j < Nj; ++j)
+      for (size_t k = 0; k < Nk; ++k)
+        g.relem(i, j, k) = slab(int(i + i0), int(j), int(k));
+
+  if (zeromean)
+  {
+    const real_t mean = g.mean();
+
+    #pragma omp parallel for
+    for (size_t i = 0; i < Ni; ++i)
+      for (size_t j = 0; j < Nj; ++j)
+        for (size_t k = 0; k < Nk; ++k)
+          g.relem(i, j, k) -= mean;
+  }
+}
+
+void RNG_music::compute_random_numbers_distributed(Grid_FFT<real_t> &g)
+{
+  //... the distributed path is only taken if all levels are given by seeds, on which grafic_sign has no effect
+  if (pcf_->get_value_safe<bool>("random", "grafic_sign", false))
+  {
+    music::wlog.Print("MUSIC1 RNG plugin: grafic_sign only applies to white noise files and is ignored for seeds");
+  }
+
+  bool music2_rng = pcf_->get_value_safe<bool>("random", "music2_rng", false);
+  if (music2_rng)
+  {
+    music::ilog.Print("MUSIC1 RNG plugin: using MUSIC2 compatible seeds");
+  }
+
+  using grid_t = Grid_FFT<real_t>;
+  auto make_grid = [](int ilevel) {
+    const size_t n = size_t(1) << ilevel;
+    return std::make_unique<grid_t>(std::array<size_t, 3>{n, n, n}, std::array<real_t, 3>{1.0, 1.0, 1.0});
+  };
+
+  //... seeds are given for levelmin, generate directly
+  if (levelmin_seed_ == levelmin_)
+  {
+    fill_level_slab(g, levelmin_, true);
+    return;
+  }
+
+  //... seeds are given for a level coarser than levelmin, refine by coarse mode replacement in k-space
+  if (levelmin_seed_ < levelmin_)
+  {
+    std::unique_ptr<grid_t> coarse = make_grid(levelmin_seed_);
+    fill_level_slab(*coarse, levelmin_seed_, true);
+
+    for (int ilevel = levelmin_seed_ + 1; ilevel <= levelmin_; ++ilevel)
+    {
+      music::ilog.Print("Generating a constrained random number set with seed %ld\n    using coarse mode replacement...", rngseeds_[ilevel]);
+
+      std::unique_ptr<grid_t> fine_ptr = (ilevel < levelmin_) ? make_grid(ilevel) : nullptr;
+      grid_t &fine = (ilevel < levelmin_) ? *fine_ptr : g;
+      grid_t ctmp(fine.n_, fine.length_);
+
+      fill_level_slab(fine, ilevel, false);
+
+      // the coarse modes are redistributed to the fine k-space slabs
+      coarse->FourierInterpolateCopyTo(ctmp);
+      coarse.reset();
+      fine.FourierTransformForward();
+
+      // both grids use the unitary FFT normalisation, so no rescaling of the coarse modes is needed
+      const double nc = double(fine.n_[0] / 2);
+      const double phasefac = -0.5;
+
+      #pragma omp parallel for
+      for (size_t i = 0; i < fine.size(0); ++i)
+        for (size_t j = 0; j < fine.size(1); ++j)
+          for (size_t k = 0; k < fine.size(2); ++k)
+          {
+            auto kk = fine.get_k3(i, j, k);
+            double kx = (kk[0] <= fine.n_[0] / 2) ? double(kk[0]) : double(kk[0]) - double(fine.n_[0]);
+            double ky = (kk[1] <= fine.n_[1] / 2) ? double(kk[1]) : double(kk[1]) - double(fine.n_[1]);
+            double kz = double(kk[2]);
+
+            // only modes present on the coarse level, except its Nyquist planes
+            if (std::abs(kx) >= 0.5 * nc || std::abs(ky) >= 0.5 * nc || kz >= 0.5 * nc)
+              continue;
+
+            double phase = (kx / nc + ky / nc + kz / nc) * phasefac * M_PI;
+            ccomplex_t val = ctmp.kelem(i, j, k) * ccomplex_t(std::cos(phase), std::sin(phase));
+
+            double blend_coarse = Meyer_scaling_function(kx, nc / 2) * Meyer_scaling_function(ky, nc / 2) * Meyer_scaling_function(kz, nc / 2);
+            double blend_fine = std::sqrt(1.0 - blend_coarse * blend_coarse);
+
+            fine.kelem(i, j, k) = real_t(blend_fine) * fine.kelem(i, j, k) + real_t(blend_coarse) * val;
+          }
+
+      fine.FourierTransformBackward();
+
+      if (ilevel < levelmin_)
+        coarse = std::move(fine_ptr);
+    }
+    return;
+  }
+
+  //... seeds are given for a level finer than levelmin, obtain by k-space degrading
+  std::unique_ptr<grid_t> fine = make_grid(levelmin_seed_);
+  fill_level_slab(*fine, levelmin_seed_, true);
+
+  for (int ilevel = levelmin_seed_ - 1; ilevel >= levelmin_; --ilevel)
+  {
+    if (rngseeds_[ilevel] > 0)
+      music::ilog.Print("Warning: random seed for level %d will be ignored.\n"
+                        "            consistency requires that it is obtained by restriction from level %d",
+                        ilevel, levelmin_seed_);
+
+    music::ilog.Print("Generating a coarse white noise field by k-space degrading");
+
+    std::unique_ptr<grid_t> coarse_ptr = (ilevel > levelmin_) ? make_grid(ilevel) : nullptr;
+    grid_t &coarse = (ilevel > levelmin_) ? *coarse_ptr : g;
+
+    // unlike the serial degrade, which fills the coarse Nyquist planes from the fine +n/2 modes,
+    // FourierInterpolateCopyTo only copies modes present in both grids and leaves these planes zero;
+    // the degraded noise thus differs from the serial one in the coarse Nyquist planes only
+    fine->FourierInterpolateCopyTo(coarse);
+    fine.reset();
+
+    const double nc = double(coarse.n_[0]);
+
+    #pragma omp parallel for
+    for (size_t i = 0; i < coarse.size(0); ++i)
+      for (size_t j = 0; j < coarse.size(1); ++j)
+        for (size_t k = 0; k < coarse.size(2); ++k)
+        {
+          auto kk = coarse.get_k3(i, j, k);
+          double kx = (kk[0] <= coarse.n_[0] / 2) ? double(kk[0]) : double(kk[0]) - nc;
+          double ky = (kk[1] <= coarse.n_[1] / 2) ? double(kk[1]) : double(kk[1]) - nc;
+          double kz = double(kk[2]);
+
+          double phase = (kx / nc + ky / nc + kz / nc) * 0.5 * M_PI;
+          coarse.kelem(i, j, k) *= ccomplex_t(std::cos(phase), std::sin(phase));
+        }
+
+    coarse.FourierTransformBackward();
+
+    if (ilevel > levelmin_)
+      fine = std::move(coarse_ptr);
+  }
+}
+
 namespace
 {
 RNG_plugin_creator_concrete<RNG_music> creator("MUSIC1");
@@ -22,21 +22,6 @@
 #include <random_plugin.hh>
 #include "random_music_wnoise_generator.hh"
 
-inline double Meyer_scaling_function( double k, double kmax )
-{
-  constexpr double twopithirds{2.0*M_PI/3.0};
-  constexpr double fourpithirds{4.0*M_PI/3.0};
-  auto nu = []( double x ){ return x<0.0?0.0:(x<1.0?x:1.0); };
-
-  k = std::abs(k)/kmax * 2 * M_PI;
-
-  if( k < twopithirds ) return 1.0;
-  else if( k< fourpithirds ){
-    return std::cos( 0.5*M_PI * nu(3*k/(2*M_PI)-1.0) );
-  }
-  return 0.0;
-}
-
 template <typename T>
 music_wnoise_generator<T>::music_wnoise_generator(unsigned res, unsigned cubesize, long baseseed, int *x0, int *lx)
     : res_(res), cubesize_(cubesize), ncubes_(1), baseseed_(baseseed)
@@ -80,6 +65,16 @@ music_wnoise_generator<T>::music_wnoise_generator(unsigned res, unsigned cubesiz
   }
 }
 
+template <typename T>
+music_wnoise_generator<T>::music_wnoise_generator(unsigned res, unsigned cubesize, long baseseed, size_t i0, size_t ni)
+    : res_(res), cubesize_(cubesize), ncubes_(1), baseseed_(baseseed)
+{
+  music::ilog.Print("Generating random numbers (slab) with seed %ld", baseseed);
+
+  initialize();
+  fill_slab(i0, ni);
+}
+
 template <typename T>
 music_wnoise_generator<T>::music_wnoise_generator(unsigned res, std::string randfname, bool randsign)
     : res_(res), cubesize_(res), ncubes_(1)
@@ -760,6 +755,34 @@ double music_wnoise_generator<T>::fill_subvolume(int *i0, int *n)
   return mean / (ncube[0] * ncube[1] * ncube[2]);
 }
 
+template <typename T>
+double music_wnoise_generator<T>::fill_slab(size_t i0, size_t ni)
+{
+  if (ni == 0)
+    return 0.0;
+
+  // cubes straddling the slab boundary are generated by both neighbouring tasks, which is
+  // cheaper than communicating them, since every cube is seeded independently
+  const int ic0 = int(i0 / cubesize_);
+  const int ic1 = int((i0 + ni - 1) / cubesize_) + 1;
+
+  for (int i = ic0; i < ic1; ++i)
+    for (int j = 0; j < (int)ncubes_; ++j)
+      for (int k = 0; k < (int)ncubes_; ++k)
+        register_cube(i, j, k);
+
+  double sum = 0.0;
+
+#pragma omp parallel for collapse(2) reduction(+ \
+                                               : sum)
+  for (int i = ic0; i < ic1; ++i)
+    for (int j = 0; j < (int)ncubes_; ++j)
+      for (int k = 0; k < (int)ncubes_; ++k)
+        sum += fill_cube(i, j, k);
+
+  return sum / ((ic1 - ic0) * ncubes_ * ncubes_);
+}
+
 template <typename T>
 double music_wnoise_generator<T>::fill_all(void)
 {
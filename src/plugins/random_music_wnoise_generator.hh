@@ -18,11 +18,28 @@
 
 #include <vector>
 #include <map>
+#include <cmath>
 #include <general.hh>
 //#include "mesh.hh"
 
 #define DEF_RAN_CUBE_SIZE 32
 
+//! Meyer wavelet scaling function, used to blend coarse and fine white noise in Fourier space
+inline double Meyer_scaling_function( double k, double kmax )
+{
+  constexpr double twopithirds{2.0*M_PI/3.0};
+  constexpr double fourpithirds{4.0*M_PI/3.0};
+  auto nu = []( double x ){ return x<0.0?0.0:(x<1.0?x:1.0); };
+
+  k = std::abs(k)/kmax * 2 * M_PI;
+
+  if( k < twopithirds ) return 1.0;
+  else if( k< fourpithirds ){
+    return std::cos( 0.5*M_PI * nu(3*k/(2*M_PI)-1.0) );
+  }
+  return 0.0;
+}
+
 /*!
  * @brief encapsulates all things random number generator related
  */
@@ -117,6 +134,9 @@ protected:
   //! fill a cubic subvolume of the full grid with random numbers
   double fill_subvolume(int *i0, int *n);
 
+  //! fill all cubes intersecting a slab [i0,i0+ni) along the first dimension with random numbers
+  double fill_slab(size_t i0, size_t ni);
+
   //! fill an entire grid with random numbers
   double fill_all(void);
 
@@ -168,6 +188,9 @@ public:
   //! constructor
   music_wnoise_generator(unsigned res, unsigned cubesize, long baseseed, bool zeromean = true);
 
+  //! constructor for a slab of the full field, only cubes intersecting [i0,i0+ni) are generated
+  music_wnoise_generator(unsigned res, unsigned cubesize, long baseseed, size_t i0, size_t ni);
+
   //! constructor to read white noise from file
   music_wnoise_generator(unsigned res, std::string randfname, bool rndsign);
 
@@ -23,6 +23,7 @@
 
 #include <vector>
 #include <cmath>
+#include <algorithm>
 
 #include <grid_fft.hh>
 #include <gsl/gsl_rng.h>
@@ -80,76 +81,103 @@ public:
     }
 
     bool isMultiscale() const { return false; }
+    bool isRepeatable() const { return true; }
 
     void Fill_Grid(Grid_FFT<real_t> &g) //const
     {
         g.zero();
         g.FourierTransformForward(false);
 
-        // transform is transposed!
-        for (size_t i = 0; i < nres_; ++i) 
+        const size_t i0 = g.local_1_start_, i1 = g.local_1_start_ + g.local_1_size_;
+
+        // collect the columns (first index of transposed grid) this task needs: all locally owned
+        // columns, plus the conjugate partners whose k=0 plane maps into the local slab
+        std::vector<size_t> columns;
+        columns.reserve(2 * g.local_1_size_);
+        for (size_t i = i0; i < i1; ++i)
         {
-            size_t ii  = (i>0)? nres_ - i : 0;
-            size_t ip  = i - g.local_1_start_;
-            size_t iip = ii- g.local_1_start_;
-            bool i_in_range  = (i >= size_t(g.local_1_start_) && i < size_t(g.local_1_start_+g.local_1_size_));
-            bool ii_in_range = (ii >= size_t(g.local_1_start_) && ii < size_t(g.local_1_start_ + g.local_1_size_));
+            size_t ii = (i>0)? nres_ - i : 0;
+            columns.push_back(i);
+            if (ii < i0 || ii >= i1) columns.push_back(ii);
+        }
+        std::sort(columns.begin(), columns.end());
+        columns.erase(std::unique(columns.begin(), columns.end()), columns.end());
 
-            if( i_in_range || ii_in_range )
+        const size_t ncolumns = columns.size();
+
+        // every (i,j) pencil is generated from its own seed, so pencils are independent and can be
+        // distributed over threads, each thread owning its generator; the k=0 targets of distinct
+        // pencils never coincide, so no synchronisation is needed on writes
+        #pragma omp parallel
+        {
+            gsl_rng *pThreadGenerator = gsl_rng_alloc(gsl_rng_ranlxd1);
+
+            #pragma omp for schedule(dynamic)
+            for (size_t ij = 0; ij < ncolumns * nres_; ++ij)
             {
-                for (size_t j = 0; j < nres_; ++j) 
-                {                   
-                    ptrdiff_t jj = (j>0)? nres_ - j : 0;
-                    if( g.is_distributed() )
-                        gsl_rng_set( pRandomGenerator_, SeedTable_[j * nres_ + i]);
-                    else
-                        gsl_rng_set( pRandomGenerator_, SeedTable_[i * nres_ + j]);
-                    
-                    for (size_t k = 0; k < g.size(2); ++k) 
-                    {
-                        double phase = gsl_rng_uniform(pRandomGenerator_) * 2 * M_PI;
-                        double ampl = 0;
-
-                        do {
-                            ampl = gsl_rng_uniform(pRandomGenerator_);
-                        } while (ampl == 0||ampl == 1);
-
-                        if (i == nres_ / 2 || j == nres_ / 2 || k == nres_ / 2) continue;
-                        if (i == 0 && j == 0 && k == 0) continue;
-
-                        ampl = std::sqrt(-std::log(ampl));
-                        ccomplex_t zrand(ampl*std::cos(phase),ampl*std::sin(phase));
-
-                        if (k > 0) {
-                            if (i_in_range) g.kelem(ip,j,k) = zrand;
-                        } else{ /* k=0 plane needs special treatment */
-                            if( g.is_distributed() ){
-                                if (j == 0) {
-                                    if (i < nres_ / 2 )
-                                    {
-                                        if(i_in_range) g.kelem(ip,jj,k) = zrand;
-                                        if(ii_in_range) g.kelem(iip,j,k) = std::conj(zrand);
-                                    }
-                                } else if (j < nres_ / 2) {
-                                    if(i_in_range) g.kelem(ip,j,k) = zrand;
-                                    if(ii_in_range) g.kelem(iip,jj,k) = std::conj(zrand);
+                const size_t i   = columns[ij / nres_];
+                const size_t j   = ij % nres_;
+                const size_t ii  = (i>0)? nres_ - i : 0;
+                const size_t ip  = i - g.local_1_start_;
+                const size_t iip = ii- g.local_1_start_;
+                const bool i_in_range  = (i >= i0 && i < i1);
+                const bool ii_in_range = (ii >= i0 && ii < i1);
+                const size_t jj = (j>0)? nres_ - j : 0;
+
+                if( g.is_distributed() )
+                    gsl_rng_set( pThreadGenerator, SeedTable_[j * nres_ + i]);
+                else
+                    gsl_rng_set( pThreadGenerator, SeedTable_[i * nres_ + j]);
+
+                // conjugate partner columns only contribute their k=0 value
+                const size_t kmax = i_in_range ? g.size(2) : 1;
+
+                for (size_t k = 0; k < kmax; ++k)
+                {
+                    double phase = gsl_rng_uniform(pThreadGenerator) * 2 * M_PI;
+                    double ampl = 0;
+
+                    do {
+                        ampl = gsl_rng_uniform(pThreadGenerator);
+                    } while (ampl == 0||ampl == 1);
+
+                    if (i == nres_ / 2 || j == nres_ / 2 || k == nres_ / 2) continue;
+                    if (i == 0 && j == 0 && k == 0) continue;
+
+                    ampl = std::sqrt(-std::log(ampl));
+                    ccomplex_t zrand(ampl*std::cos(phase),ampl*std::sin(phase));
+
+                    if (k > 0) {
+                        g.kelem(ip,j,k) = zrand;
+                    } else{ /* k=0 plane needs special treatment */
+                        if( g.is_distributed() ){
+                            if (j == 0) {
+                                if (i < nres_ / 2 )
+                                {
+                                    if(i_in_range) g.kelem(ip,jj,k) = zrand;
+                                    if(ii_in_range) g.kelem(iip,j,k) = std::conj(zrand);
                                 }
-                            }else{
-                                if (i == 0) {
-                                    if (j < nres_ / 2 && i_in_range)
-                                    {
-                                        g.kelem(ip,j,k) = zrand;
-                                        g.kelem(ip,jj,k) = std::conj(zrand);
-                                    }
-                                } else if (i < nres_ / 2) {
-                                    if(i_in_range) g.kelem(ip,j,k) = zrand;
-                                    if(ii_in_range) g.kelem(iip,jj,k) = std::conj(zrand);
+                            } else if (j < nres_ / 2) {
+                                if(i_in_range) g.kelem(ip,j,k) = zrand;
+                                if(ii_in_range) g.kelem(iip,jj,k) = std::conj(zrand);
+                            }
+                        }else{
+                            if (i == 0) {
+                                if (j < nres_ / 2 && i_in_range)
+                                {
+                                    g.kelem(ip,j,k) = zrand;
+                                    g.kelem(ip,jj,k) = std::conj(zrand);
                                 }
+                            } else if (i < nres_ / 2) {
+                                if(i_in_range) g.kelem(ip,j,k) = zrand;
+                                if(ii_in_range) g.kelem(iip,jj,k) = std::conj(zrand);
                             }
                         }
                     }
                 }
             }
+
+            gsl_rng_free(pThreadGenerator);
         }
     }
 };
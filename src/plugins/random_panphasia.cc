@@ -159,7 +159,7 @@ void RNG_panphasia::Run_Panphasia_Highorder(Grid_FFT<real_t> &g)
 
   size_t N0 = fdim * (PANPHASIA2::descriptor_base_size << rel_level);
 
-  alloc_local = FFTW_MPI_LOCAL_SIZE_3D(N0, N0, N0 + 2, MPI_COMM_WORLD, &local_n0, &local_0_start);
+  alloc_local = FFTW_MPI_LOCAL_SIZE_3D(N0, N0, N0 + 2, MPI::get_comm(), &local_n0, &local_0_start);
 
   Grid_FFT<real_t> pan_grid({{N0, N0, N0}}, {{boxlength_, boxlength_, boxlength_}});
 
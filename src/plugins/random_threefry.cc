@@ -0,0 +1,96 @@
+// This file is part of monofonIC (MUSIC2)
+// A software package to generate ICs for cosmological simulations
+// Copyright (C) 2020 by Oliver Hahn
+//
+// monofonIC is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// monofonIC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <general.hh>
+#include <random_plugin.hh>
+#include <config_file.hh>
+
+#include <grid_fft.hh>
+#include <vector>
+#include "random_threefry.hh"
+
+class RNG_threefry : public RNG_plugin
+{
+private:
+  long RandomSeed_;
+  size_t nres_;
+  bool bfourier_;
+  threefry_noise noise_;
+
+public:
+  explicit RNG_threefry(config_file &cf)
+      : RNG_plugin(cf), RandomSeed_(cf.get_value<long>("random", "seed")),
+        nres_(cf.get_value<size_t>("setup", "GridRes")),
+        bfourier_(cf.get_value_safe<std::string>("random", "ThreefrySpace", "real") == "fourier"),
+        noise_(RandomSeed_, nres_)
+  {
+    music::ilog << "Threefry white noise will be generated in " << (bfourier_ ? "Fourier" : "real") << " space." << std::endl;
+  }
+
+  virtual ~RNG_threefry() {}
+
+  bool isMultiscale() const { return false; }
+  bool isRepeatable() const { return true; }
+
+  void Fill_Grid(Grid_FFT<real_t> &g)
+  {
+    if (bfourier_)
+    {
+      g.FourierTransformForward(false);
+
+      #pragma omp parallel
+      {
+        std::vector<uint64_t> u0(nres_ / 2 + 1), u1(nres_ / 2 + 1);
+
+        #pragma omp for collapse(2)
+        for (size_t i = 0; i < g.size(0); ++i)
+        {
+          for (size_t j = 0; j < g.size(1); ++j)
+          {
+            // transform is transposed if distributed!
+            const size_t ix = g.is_distributed() ? j : i;
+            const size_t iy = g.is_distributed() ? i + g.local_1_start_ : j;
+            noise_.fill_mode_row(ix, iy, &g.kelem(i, j, 0), u0.data(), u1.data());
+          }
+        }
+      }
+    }
+    else
+    {
+      g.FourierTransformBackward(false);
+
+      #pragma omp parallel
+      {
+        std::vector<uint64_t> u0(nres_), u1(nres_);
+
+        #pragma omp for collapse(2)
+        for (size_t i = 0; i < g.size(0); ++i)
+        {
+          for (size_t j = 0; j < g.size(1); ++j)
+          {
+            noise_.fill_row(ptrdiff_t(i + g.local_0_start_), ptrdiff_t(j), 0, g.size(2), &g.relem(i, j, 0), u0.data(), u1.data());
+          }
+        }
+      }
+    }
+  }
+};
+
+namespace
+{
+RNG_plugin_creator_concrete<RNG_threefry> creator("THREEFRY");
+}
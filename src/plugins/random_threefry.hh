@@ -0,0 +1,211 @@
+// This file is part of monofonIC (MUSIC2)
+// A software package to generate ICs for cosmological simulations
+// Copyright (C) 2020 by Oliver Hahn
+//
+// monofonIC is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// monofonIC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <complex>
+#include <vector>
+
+#include <general.hh>
+#include <panphasia_ho/threefry.h>
+
+/*!
+ * @brief counter based white noise generator built on Threefry-4x64-20
+ *
+ * Every real space cell and every Fourier mode is a pure function of the seed and its
+ * global index, so any cell or mode can be (re-)generated independently in O(1), without
+ * seed tables, and the resulting field does not depend on the MPI or thread decomposition.
+ * Rows are filled in two passes, the raw Threefry words of consecutive counters first and
+ * then the Box-Muller transform of the whole row.
+ */
+class threefry_noise
+{
+public:
+  //! counter stream used for each generation mode, keeps real and Fourier space realisations uncorrelated
+  enum stream_t : uint64_t { real_stream = 0, fourier_stream = 1 };
+
+protected:
+  threefry4x64_key_t key_;
+  size_t nres_;
+
+  //! convert 64 random bits to a double uniformly distributed in the open interval (0,1)
+  static inline double to_uniform(uint64_t x) noexcept
+  {
+    return (double(x >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+  }
+
+  inline threefry4x64_ctr_t draw(uint64_t idx, uint64_t stream) const noexcept
+  {
+    threefry4x64_ctr_t ctr = {{idx, stream, 0, 0}};
+    return threefry4x64_R(20, ctr, key_);
+  }
+
+public:
+  threefry_noise(long seed, size_t nres)
+      : nres_(nres)
+  {
+    // second key word is an arbitrary constant, so that seeds do not collide with other Threefry users
+    key_ = {{uint64_t(seed), 0x6d6f6e6f66724943ull, 0, 0}};
+  }
+
+  size_t size(void) const noexcept { return nres_; }
+
+  //! unit variance Gaussian deviate of global real space cell (i,j,k), indices are taken periodically
+  inline double get_cell(ptrdiff_t i, ptrdiff_t j, ptrdiff_t k) const noexcept
+  {
+    const ptrdiff_t n = ptrdiff_t(nres_);
+    i = (i % n + n) % n;
+    j = (j % n + n) % n;
+    k = (k % n + n) % n;
+    const auto r = draw((uint64_t(i) * nres_ + uint64_t(j)) * nres_ + uint64_t(k), real_stream);
+    return std::sqrt(-2.0 * std::log(to_uniform(r.v[0]))) * std::cos(2.0 * M_PI * to_uniform(r.v[1]));
+  }
+
+  /*!
+   * @brief complex Gaussian deviate with <|z|^2>=1 of global mode (ix,iy,iz), 0<=ix,iy<N, 0<=iz<=N/2
+   *
+   * Hermitian symmetry in the iz=0 plane is obtained by always drawing the mode with the smaller
+   * linear index of a conjugate pair, and conjugating for the partner. Nyquist planes and the DC
+   * mode are zero, as with the NGenIC convention.
+   */
+  inline std::complex<double> get_mode(size_t ix, size_t iy, size_t iz) const noexcept
+  {
+    const size_t nh = nres_ / 2;
+    if (ix == nh || iy == nh || iz == nh || (ix == 0 && iy == 0 && iz == 0))
+      return {0.0, 0.0};
+
+    bool bconj = false;
+    if (iz == 0)
+    {
+      const size_t iix = (nres_ - ix) % nres_, iiy = (nres_ - iy) % nres_;
+      if (iix * nres_ + iiy < ix * nres_ + iy)
+      {
+        ix = iix;
+        iy = iiy;
+        bconj = true;
+      }
+    }
+
+    const auto r = draw((uint64_t(ix) * nres_ + uint64_t(iy)) * (nh + 1) + uint64_t(iz), fourier_stream);
+    const double ampl = std::sqrt(-std::log(to_uniform(r.v[0])));
+    const double phase = 2.0 * M_PI * to_uniform(r.v[1]);
+    return {ampl * std::cos(phase), (bconj ? -1.0 : 1.0) * ampl * std::sin(phase)};
+  }
+
+  //! the first two words of the blocks of n consecutive counters starting at idx0, the counters
+  //! are computed once for the row, so the loop has no index arithmetic or wrapping
+  inline void draw_row(uint64_t idx0, size_t n, uint64_t stream, uint64_t *u0, uint64_t *u1) const noexcept
+  {
+    for (size_t k = 0; k < n; ++k)
+    {
+      const auto r = draw(idx0 + k, stream);
+      u0[k] = r.v[0];
+      u1[k] = r.v[1];
+    }
+  }
+
+  //! Box-Muller transform of a row of raw draws into unit variance Gaussian deviates, as get_cell()
+  template <typename T>
+  static void gaussian_row(size_t n, const uint64_t *u0, const uint64_t *u1, T *out) noexcept
+  {
+    for (size_t k = 0; k < n; ++k)
+      out[k] = T(std::sqrt(-2.0 * std::log(to_uniform(u0[k]))) * std::cos(2.0 * M_PI * to_uniform(u1[k])));
+  }
+
+  /*!
+   * @brief cells k0..k0+n-1 (wrapped periodically) of the real space row (i,j), same values as get_cell()
+   *
+   * @param u0, u1 scratch space for min(n,N) raw draws each
+   */
+  template <typename T>
+  void fill_row(ptrdiff_t i, ptrdiff_t j, ptrdiff_t k0, size_t n, T *out, uint64_t *u0, uint64_t *u1) const noexcept
+  {
+    const ptrdiff_t nr = ptrdiff_t(nres_);
+    i = (i % nr + nr) % nr;
+    j = (j % nr + nr) % nr;
+    const uint64_t idxrow = (uint64_t(i) * nres_ + uint64_t(j)) * nres_;
+
+    // the row is split into runs of consecutive counters at the periodic boundary
+    size_t kw = size_t((k0 % nr + nr) % nr);
+    for (size_t m = 0; m < n;)
+    {
+      const size_t nrun = std::min(n - m, nres_ - kw);
+      this->draw_row(idxrow + kw, nrun, real_stream, u0, u1);
+      gaussian_row(nrun, u0, u1, out + m);
+      m += nrun;
+      kw = 0;
+    }
+  }
+
+  /*!
+   * @brief Fourier modes iz=0..N/2 of the row (ix,iy), same values as get_mode()
+   *
+   * @param u0, u1 scratch space for N/2+1 raw draws each
+   */
+  template <typename T>
+  void fill_mode_row(size_t ix, size_t iy, std::complex<T> *out, uint64_t *u0, uint64_t *u1) const noexcept
+  {
+    const size_t nh = nres_ / 2;
+    if (ix == nh || iy == nh)
+    {
+      for (size_t k = 0; k <= nh; ++k)
+        out[k] = 0.0;
+      return;
+    }
+
+    this->draw_row((uint64_t(ix) * nres_ + uint64_t(iy)) * (nh + 1), nh + 1, fourier_stream, u0, u1);
+    for (size_t k = 0; k <= nh; ++k)
+    {
+      const double ampl = std::sqrt(-std::log(to_uniform(u0[k])));
+      const double phase = 2.0 * M_PI * to_uniform(u1[k]);
+      out[k] = std::complex<T>(T(ampl * std::cos(phase)), T(ampl * std::sin(phase)));
+    }
+
+    // the iz=0 mode may be the conjugate partner of another row, the Nyquist mode is zero
+    out[0] = std::complex<T>(this->get_mode(ix, iy, 0));
+    out[nh] = 0.0;
+  }
+
+  /*!
+   * @brief fill a real space sub-volume, e.g. for streaming or out-of-core generation
+   *
+   * @param origin global index of the first cell, may lie outside [0,N), wrapped periodically
+   * @param extent number of cells along each dimension
+   * @param out pointer to extent[0]*extent[1]*extent[2] values, stored row-major (last index fastest)
+   */
+  template <typename T>
+  void fill_subvolume(const std::array<ptrdiff_t, 3> &origin, const std::array<size_t, 3> &extent, T *out) const
+  {
+    #pragma omp parallel
+    {
+      std::vector<uint64_t> u0(std::min(extent[2], nres_)), u1(u0.size());
+
+      #pragma omp for collapse(2)
+      for (size_t i = 0; i < extent[0]; ++i)
+      {
+        for (size_t j = 0; j < extent[1]; ++j)
+        {
+          this->fill_row(origin[0] + ptrdiff_t(i), origin[1] + ptrdiff_t(j), origin[2], extent[2],
+                         &out[(i * extent[1] + j) * extent[2]], u0.data(), u1.data());
+        }
+      }
+    }
+  }
+};
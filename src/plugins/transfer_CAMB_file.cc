@@ -114,7 +114,7 @@ private:
 
 #if defined(USE_MPI)
     unsigned n = k.size();
-    MPI_Bcast(&n, 1, MPI_UNSIGNED, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&n, 1, MPI_UNSIGNED, 0, MPI::get_comm());
 
     if (CONFIG::MPI_task_rank > 0)
     {
@@ -129,15 +129,15 @@ private:
       tm.assign(n, 0);
     }
 
-    MPI_Bcast(&k[0],  n, MPI_DOUBLE, 0, MPI_COMM_WORLD);
-    MPI_Bcast(&dc[0], n, MPI_DOUBLE, 0, MPI_COMM_WORLD);
-    MPI_Bcast(&tc[0], n, MPI_DOUBLE, 0, MPI_COMM_WORLD);
-    MPI_Bcast(&db[0], n, MPI_DOUBLE, 0, MPI_COMM_WORLD);
-    MPI_Bcast(&tb[0], n, MPI_DOUBLE, 0, MPI_COMM_WORLD);
-    MPI_Bcast(&dn[0], n, MPI_DOUBLE, 0, MPI_COMM_WORLD);
-    MPI_Bcast(&tn[0], n, MPI_DOUBLE, 0, MPI_COMM_WORLD);
-    MPI_Bcast(&dm[0], n, MPI_DOUBLE, 0, MPI_COMM_WORLD);
-    MPI_Bcast(&tm[0], n, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&k[0],  n, MPI_DOUBLE, 0, MPI::get_comm());
+    MPI_Bcast(&dc[0], n, MPI_DOUBLE, 0, MPI::get_comm());
+    MPI_Bcast(&tc[0], n, MPI_DOUBLE, 0, MPI::get_comm());
+    MPI_Bcast(&db[0], n, MPI_DOUBLE, 0, MPI::get_comm());
+    MPI_Bcast(&tb[0], n, MPI_DOUBLE, 0, MPI::get_comm());
+    MPI_Bcast(&dn[0], n, MPI_DOUBLE, 0, MPI::get_comm());
+    MPI_Bcast(&tn[0], n, MPI_DOUBLE, 0, MPI::get_comm());
+    MPI_Bcast(&dm[0], n, MPI_DOUBLE, 0, MPI::get_comm());
+    MPI_Bcast(&tm[0], n, MPI_DOUBLE, 0, MPI::get_comm());
 #endif
 
     delta_c_.set_data(k, dc);
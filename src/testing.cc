@@ -16,6 +16,7 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <testing.hh>
+#include <ic_generator.hh>
 #include <unistd.h> // for unlink
 #include <memory>
 
@@ -26,15 +27,15 @@ namespace testing
 {
 
 void output_potentials_and_densities(
-    config_file &the_config,
+    config_file &the_config, const std::string &suffix,
     size_t ngrid, real_t boxlen,
     Grid_FFT<real_t> &phi,
     Grid_FFT<real_t> &phi2,
     Grid_FFT<real_t> &phi3,
     std::array<Grid_FFT<real_t> *, 3> &A3)
 {
-    const std::string fname_hdf5 = the_config.get_value_safe<std::string>("output", "fname_hdf5", "output.hdf5");
-    const std::string fname_analysis = the_config.get_value_safe<std::string>("output", "fbase_analysis", "output");
+    const std::string fname_hdf5 = ic_generator::suffixed_filename(the_config.get_value_safe<std::string>("output", "fname_hdf5", "output.hdf5"), suffix);
+    const std::string fname_analysis = the_config.get_value_safe<std::string>("output", "fbase_analysis", "output") + suffix;
 
     Grid_FFT<real_t> delta({ngrid, ngrid, ngrid}, {boxlen, boxlen, boxlen});
     Grid_FFT<real_t> delta2({ngrid, ngrid, ngrid}, {boxlen, boxlen, boxlen});
@@ -81,7 +82,7 @@ void output_potentials_and_densities(
 #if defined(USE_MPI)
     if (CONFIG::MPI_task_rank == 0)
         unlink(fname_hdf5.c_str());
-    MPI_Barrier(MPI_COMM_WORLD);
+    MPI_Barrier(MPI::get_comm());
 #else
     unlink(fname_hdf5.c_str());
 #endif
@@ -100,7 +101,7 @@ void output_potentials_and_densities(
 }
 
 void output_velocity_displacement_symmetries(
-    config_file &the_config,
+    config_file &the_config, const std::string &suffix,
     size_t ngrid, real_t boxlen, real_t vfac, real_t dplus,
     Grid_FFT<real_t> &phi,
     Grid_FFT<real_t> &phi2,
@@ -108,8 +109,8 @@ void output_velocity_displacement_symmetries(
     std::array<Grid_FFT<real_t> *, 3> &A3,
     bool bwrite_out_fields)
 {
-    const std::string fname_hdf5 = the_config.get_value_safe<std::string>("output", "fname_hdf5", "output.hdf5");
-    const std::string fname_analysis = the_config.get_value_safe<std::string>("output", "fbase_analysis", "output");
+    const std::string fname_hdf5 = ic_generator::suffixed_filename(the_config.get_value_safe<std::string>("output", "fname_hdf5", "output.hdf5"), suffix);
+    const std::string fname_analysis = the_config.get_value_safe<std::string>("output", "fbase_analysis", "output") + suffix;
 
     real_t vfac1 = vfac;
     real_t vfac2 = 2 * vfac;
@@ -128,7 +129,7 @@ void output_velocity_displacement_symmetries(
 #if defined(USE_MPI)
     if (CONFIG::MPI_task_rank == 0)
         unlink(fname_hdf5.c_str());
-    MPI_Barrier(MPI_COMM_WORLD);
+    MPI_Barrier(MPI::get_comm());
 #else
     unlink(fname_hdf5.c_str());
 #endif
@@ -242,7 +243,7 @@ void output_velocity_displacement_symmetries(
 }
 
 void output_convergence(
-    config_file &the_config,
+    config_file &the_config, const std::string &suffix,
     cosmology::calculator* the_cosmo_calc,
     std::size_t ngrid, real_t boxlen, real_t vfac, real_t dplus,
     Grid_FFT<real_t> &phi,
@@ -435,10 +436,10 @@ void output_convergence(
     }
 
     ////////////////////////////// write results ///////////////////////////////
-    std::string convergence_test_filename("convergence_test.hdf5");
+    std::string convergence_test_filename(ic_generator::suffixed_filename("convergence_test.hdf5", suffix));
     unlink(convergence_test_filename.c_str());
 #if defined(USE_MPI)
-    MPI_Barrier(MPI_COMM_WORLD);
+    MPI_Barrier(MPI::get_comm());
 #endif
     t_eds.Write_to_HDF5(convergence_test_filename, "t_eds");
     inv_convergence_radius.Write_to_HDF5(convergence_test_filename, "inv_convergence_radius");